@@ -0,0 +1,46 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include "options.h"
+
+// Default -queue: images waiting between two pipeline stages
+#define BATCH_DEFAULT_QUEUE_DEPTH 2
+
+/*
+ * Converts every input named by opts->batch_source into the opts->outfilename directory, one
+ * process for the lot. The source is a directory (its regular files, dot files skipped), a
+ * wildcard pattern, or a list file with one path per line ('#' starts a comment). Each output is
+ * the input's name with the extension of the output mode, and its array is named after it.
+ *
+ * Files are handed out to opts->threads workers (0 for one per CPU), each converting one image
+ * at a time on its own thread and keeping its buffers for the next one. A file that fails is
+ * reported and the rest still run; the result is EXIT_FAILURE if any failed.
+ *
+ * With -pipeline, each image instead passes through decode, process and write stages, each on
+ * threads of its own, so one image is read while another is dithered and a third written. Bounded
+ * queues link the stages, and images cycle through a fixed set of slots whose buffers are reused:
+ * no more than the stage threads plus two queues' worth of images are ever in memory.
+ */
+int process_batch(const ProgramOptions* opts);
+
+END_EXTERN_C
+
+#endif
@@ -27,7 +27,20 @@ typedef struct {
 
 uint8_t reduceBits(uint8_t value, int max_value);
 uint8_t mapColorToR3G3B2_Reduced(uint8_t r, uint8_t g, uint8_t b);
-void quantize_pixel_with_map_reduced(uint8_t* r, uint8_t* g, uint8_t* b);
+
+uint8_t find_nearest_palette_index_search(uint8_t r, uint8_t g, uint8_t b);
+
+// RED_INDEX_SHIFT, GREEN_INDEX_SHIFT and BLUE_INDEX_SHIFT, by channel
+extern const int channelIndexShift[];
+
+int initialize_channel_quantizer(void);
+uint8_t palette_channel_level(int channel, uint8_t value);
+uint8_t palette_level_value(int channel, uint8_t level);
+void build_index_contribution_table(int channel, const uint8_t* lut, uint8_t* table);
+uint8_t nearest_palette_index_separable(uint8_t r, uint8_t g, uint8_t b);
+void quantize_pixel_separable(uint8_t* r, uint8_t* g, uint8_t* b);
+void palette_index_to_rgb(uint8_t index, uint8_t* r, uint8_t* g, uint8_t* b);
+long verify_separable_quantizer(void);
 uint8_t rgbToRgb332(uint8_t r, uint8_t g, uint8_t b);
 
 END_EXTERN_C
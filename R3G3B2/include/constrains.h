@@ -25,14 +25,23 @@ BEGIN_EXTERN_C
 
 #define R3G3B2_COLOR_COUNT 256 
 
-#define RED_LEVELS 16
-#define GREEN_LEVELS 16
-#define BLUE_LEVELS 16
+#define RED_LEVELS 8
+#define GREEN_LEVELS 8
+#define BLUE_LEVELS 4
+
+// Where each channel's level sits in an R3G3B2 index
+#define RED_INDEX_SHIFT 5
+#define GREEN_INDEX_SHIFT 2
+#define BLUE_INDEX_SHIFT 0
 
 #define BAYER_SIZE 16
+#define BLUE_NOISE_SIZE 64
 
 #define RGB332_FORMAT_ID 0x332
 
+// Part of the -cache key: bump it whenever the same input and options produce different output
+#define R3G3B2_VERSION "1.2.0"
+
 END_EXTERN_C
 
 #endif
\ No newline at end of file
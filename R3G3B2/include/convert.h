@@ -0,0 +1,33 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stdbool.h>
+
+#include "image_typedef.h"
+#include "thread_pool.h"
+#include "luts.h"
+
+bool is_fused_dither_method(int dither_method);
+int fused_convert_image(ImageData* image, const ToneLut* lut, int dither_method, ThreadPool* pool);
+
+END_EXTERN_C
+
+#endif
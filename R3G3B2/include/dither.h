@@ -21,19 +21,69 @@ BEGIN_EXTERN_C
 
 #include "image_typedef.h"
 #include "color.h"
+#include "thread_pool.h"
+#include "luts.h"
 
+#define DITHER_FLOYD_STEINBERG 0
+#define DITHER_JARVIS          1
+#define DITHER_ATKINSON        2
+#define DITHER_BAYER_16X16     3
+#define DITHER_BLUE_NOISE      4
+
+// Weights are fixed-point numerators over the matrix divisor (16, 48, 8, ...)
 typedef struct {
     int x_offset;
     int y_offset;
-    float weight;
+    int weight;
 } ErrorDiffusionEntry;
 
-int floydSteinbergDither(ImageData* image);
-int jarvisDither(ImageData* image);
-int atkinsonDither(ImageData* image);
-int bayer16x16Dither(ImageData* image);
+// Quantizes one RGB row into indices; y is the image row, for position dependent kernels
+typedef void (*IndexRowFunc)(const uint8_t* src, uint8_t* dst, int y, int width, const void* context);
+
+// Runs a per-pixel kernel over bands of rows on the pool and leaves an indexed image
+int run_index_rows(ImageData* image, ThreadPool* pool, IndexRowFunc row_func, const void* context, const char* name);
+
+// pool may be NULL to run on the calling thread only
+int floydSteinbergDither(ImageData* image, ThreadPool* pool);
+int jarvisDither(ImageData* image, ThreadPool* pool);
+int atkinsonDither(ImageData* image, ThreadPool* pool);
+
+// Same output, with R, G and B diffused as independent planes on up to three threads
+int floydSteinbergChannelDither(ImageData* image, ThreadPool* pool);
+int jarvisChannelDither(ImageData* image, ThreadPool* pool);
+int atkinsonChannelDither(ImageData* image, ThreadPool* pool);
+
+// Exact-match check of the parallel diffusion kernels against one thread, returns mismatches (-1 on failure)
+long verify_parallel_dither(void);
+
+int bayer16x16Dither(ImageData* image, ThreadPool* pool);
+int blueNoiseDither(ImageData* image, ThreadPool* pool);
+
+// Bayer or blue noise dither with a LUT folded into the tables (NULL for none)
+int ordered_dither_method(ImageData* image, ThreadPool* pool, int dither_method, const ToneLut* lut);
+
+int noDither(ImageData* image, ThreadPool* pool);
+
+// No dither through per-channel tables of index bits, with lut folded in (NULL for none)
+int index_table_convert(ImageData* image, ThreadPool* pool, const ToneLut* lut, const char* name);
+
+// Any method, reading rows in place from layout (a mapped file, say) into width * height indices.
+// lut is applied as rows are read (NULL for none); the source is never written.
+int dither_pixel_layout(const PixelLayout* layout, uint8_t* indices, ThreadPool* pool, int dither_method, const ToneLut* lut);
+
+// Dithers an image row by row, top to bottom, with memory for a few rows (any method)
+typedef struct DitherStream DitherStream;
+
+// lut is applied to every row before dithering (NULL for none)
+DitherStream* dither_stream_create(int dither_method, int width, const ToneLut* lut);
+void dither_stream_free(DitherStream* stream);
+// rgb holds the next row and may be overwritten; indices receives width palette indices
+void dither_stream_row(DitherStream* stream, uint8_t* rgb, uint8_t* indices);
 
-int noDither(ImageData* image);
+// BAYER_SIZE x BAYER_SIZE thresholds, row major
+const uint8_t* bayer16x16_matrix(void);
+// BLUE_NOISE_SIZE x BLUE_NOISE_SIZE thresholds, row major
+const uint8_t* blue_noise64x64_matrix(void);
 
 END_EXTERN_C
 
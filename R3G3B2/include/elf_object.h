@@ -0,0 +1,46 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef ELF_OBJECT_H
+#define ELF_OBJECT_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "options.h"
+
+/*
+ * Writes an indexed image as a relocatable ELF object, so it links in without being compiled:
+ * <symbol>_data holds the pixels and <symbol>_image is an Image_t pointing at them, laid out as
+ * the generated image_types.h declares it for the target.
+ *
+ * The pixels go to section (NULL for .rodata) aligned to alignment bytes (0 for none). The
+ * descriptor holds a relocated pointer, so it goes to .data.rel.ro as a compiler would put it,
+ * unless a section is named: then it follows the pixels there, and a linker script that places
+ * the section places the whole image.
+ */
+int write_elf_object(FILE* fp, ElfArch arch, const char* symbol, const uint8_t* data, int width, int height, const char* section, int alignment);
+
+// Name for messages and the -elf option, NULL for ELF_ARCH_NONE
+const char* elf_arch_name(ElfArch arch);
+// ELF_ARCH_NONE for an unknown name
+ElfArch elf_arch_from_name(const char* name);
+
+END_EXTERN_C
+
+#endif
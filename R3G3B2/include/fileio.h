@@ -23,6 +23,7 @@ BEGIN_EXTERN_C
 
 #include "options.h"
 #include "image_typedef.h"
+#include "thread_pool.h"
 
 typedef struct {
     uint16_t width;
@@ -30,9 +31,85 @@ typedef struct {
     uint16_t format_id;
 } ImageMetadata;
 
+// Most files one conversion writes: a split header, its .c file and an embedded pixel file
+#define MAX_OUTPUT_FILES 3
+
+// What the output file holds; bin_output wins if both are set, then object and assembler output
+typedef struct {
+    bool header_output;
+    bool bin_output;
+    HeaderEncoding encoding; // Header output only
+    bool split_source;       // Pixels go to a .c file beside the header, which keeps extern declarations
+    const char* section;     // Linker section for the pixel array, NULL for none
+    int alignment;           // Alignment of the pixel array in bytes, 0 for the default
+    ElfArch elf_arch;        // Relocatable object output for this target, ELF_ARCH_NONE for none
+    bool asm_output;         // GNU assembler output with the pixels in a file beside it
+    bool if_changed;         // Leave files that already hold the same bytes untouched
+} OutputFormat;
+
+/*
+ * A file being written. Normally that is straight to disk; with if_changed the bytes are built in
+ * memory (a temporary file beside it on Windows) and only replace the file, by an atomic rename,
+ * when they differ from what it holds. It must stay where it is while open.
+ */
+typedef struct {
+    FILE* fp;
+    char filename[MAX_FILENAME_LENGTH];
+    bool if_changed;
+    char* memory;        // open_memstream buffer
+    size_t memory_size;
+} OutputFile;
+
+// Writes an indexed image to a -h or -b output file one row at a time, top to bottom
+typedef struct {
+    OutputFile output;
+    const char* array_name;
+    int width;
+    int height;
+    int rows_written;
+    bool header_output;
+    OutputFormat format;
+    size_t header_bytes;  // Header file already written and closed, with split_source
+    size_t bytes_written; // Set by row_writer_finish
+} RowWriter;
+
 void free_image_memory(ImageData* image);
+void compact_indexed_image(ImageData* image);
 int load_image(const char* filename, ImageData* image);
-int write_image_data_to_file(const char* filename, const char* array_name, const ImageData* image, bool header_output, bool bin_output);
+// Header text is formatted on pool (NULL for the calling thread only).
+// bytes_written (may be NULL) receives the size of the files written.
+// With split_source, filename is the header and the .c file is named after it.
+int write_image_data_to_file(const char* filename, const char* array_name, const ImageData* image, const OutputFormat* format, ThreadPool* pool, size_t* bytes_written);
+
+// The part of path after its last '/' or '\\'
+const char* base_name(const char* path);
+// Little-endian fields of BMP and TGA headers
+uint16_t get_u16le(const uint8_t* p);
+uint32_t get_u32le(const uint8_t* p);
+
+// Renames from over to, replacing any file there
+bool replace_file(const char* from, const char* to);
+// Gives to the permission bits of from, so a replacement keeps them; true when from does not exist
+bool copy_file_mode(const char* from, const char* to);
+// true when both files can be read and hold the same bytes
+bool files_equal(const char* first, const char* second);
+// true when path is a directory afterwards, whether or not it had to be created
+bool make_directory(const char* path);
+int current_process_id(void);
+// Where filename is written before it is renamed into place. The name carries the process id,
+// so two processes writing the same output never share a temporary.
+#define TEMPORARY_FILENAME_LENGTH (MAX_FILENAME_LENGTH + 16)
+void temporary_filename(const char* filename, char* dest, size_t dest_size);
+
+// The files written for filename in this format, filename first. Returns how many, or -1 if a name is too long.
+int output_file_names(const char* filename, const char* array_name, const OutputFormat* format, char names[MAX_OUTPUT_FILES][MAX_FILENAME_LENGTH]);
+
+// The output is byte-for-byte what write_image_data_to_file writes for the same rows.
+// Header output is limited to the bytes encoding.
+int row_writer_open(RowWriter* writer, const char* filename, const char* array_name, int width, int height, const OutputFormat* format);
+int row_writer_write(RowWriter* writer, const uint8_t* indices);
+int row_writer_finish(RowWriter* writer);
+void row_writer_discard(RowWriter* writer);
 
 END_EXTERN_C
 
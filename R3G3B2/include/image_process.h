@@ -21,8 +21,49 @@ BEGIN_EXTERN_C
 
 #include "options.h"
 #include "image_typedef.h"
+#include "thread_pool.h"
+#include "luts.h"
 
-typedef int (*DitherFunc)(ImageData* image);
+typedef int (*DitherFunc)(ImageData* image, ThreadPool* pool);
+
+/*
+ * What one conversion thread keeps between images: its kernel pool, made on first use with
+ * `threads` workers, and buffers that only grow, so a batch does not allocate them per image.
+ */
+typedef struct {
+    int threads;
+    ThreadPool* pool;
+    uint8_t* indices;       // Index buffer of mapped inputs
+    size_t indices_capacity;
+    uint8_t* rows;          // RGB and index row of -stream
+    size_t rows_capacity;
+} ConvertWorker;
+
+void convert_worker_release(ConvertWorker* worker);
+
+// The LUT and the quantizer tables, built once however many images are converted
+int prepare_conversion(const ProgramOptions* opts, ToneLut* lut);
+
+// The array name an output file gives without -symbol: its name without the extension, with
+// every character a C identifier cannot hold turned into '_' and a '_' before a leading digit
+int symbol_from_filename(const char* filename, char* dest, size_t dest_size);
+
+// Converts opts->infilename to opts->outfilename, through the cache when one is set
+int convert_file(const ProgramOptions* opts, const ToneLut* lut, ConvertWorker* worker);
+
+/*
+ * One image split into three steps that may each run on a different thread: stage_decode maps or
+ * decodes opts->infilename (*pending is false when the cache restored the output instead),
+ * stage_process dithers it and stage_write writes and caches the result. Kernels run on the
+ * calling thread only. A failed step drops the image, and the StagedImage can take the next one.
+ */
+typedef struct StagedImage StagedImage;
+
+StagedImage* staged_image_create(void);
+void staged_image_free(StagedImage* staged);
+int stage_decode(StagedImage* staged, const ProgramOptions* opts, bool* pending);
+int stage_process(StagedImage* staged, const ToneLut* lut);
+int stage_write(StagedImage* staged);
 
 int process_image(ProgramOptions* opts);
 
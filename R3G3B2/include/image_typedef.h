@@ -19,14 +19,37 @@
 
 BEGIN_EXTERN_C
 
+#include <stddef.h>
 #include <stdint.h>
 
+typedef enum {
+    PIXEL_FORMAT_RGB888 = 0, // 3 bytes per pixel, R, G, B
+    PIXEL_FORMAT_INDEXED8    // 1 byte per pixel, R3G3B2 palette index (same as the packed RGB332 value)
+} PixelFormat;
+
 typedef struct {
     uint8_t* data;
     int width;
     int height;
+    PixelFormat format;
 } ImageData;
 
+typedef enum {
+    PIXEL_ORDER_RGB = 0,
+    PIXEL_ORDER_BGR,  // BMP and TGA
+    PIXEL_ORDER_GRAY  // One sample, used for R, G and B
+} PixelOrder;
+
+// Where the RGB rows of an image sit in someone else's memory (a mapped file, for instance)
+typedef struct {
+    const uint8_t* top_row;
+    ptrdiff_t row_stride; // Bytes from one row to the one below, negative for bottom-up files
+    int pixel_size;       // Bytes per pixel; anything past the samples (BMP's fourth byte) is skipped
+    PixelOrder order;
+    int width;
+    int height;
+} PixelLayout;
+
 END_EXTERN_C
 
 #endif
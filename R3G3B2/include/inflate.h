@@ -0,0 +1,39 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Supplies up to size compressed bytes, returns 0 at the end of the input
+typedef size_t (*InflateReadFunc)(void* context, uint8_t* buffer, size_t size);
+
+typedef struct Inflater Inflater;
+
+// Streaming zlib (RFC 1950/1951) decoder that only keeps the 32 KiB window in memory
+Inflater* inflater_create(InflateReadFunc read, void* context);
+void inflater_free(Inflater* inflater);
+
+// Decodes the next size bytes; returns EXIT_SUCCESS only when all of them were produced
+int inflater_read(Inflater* inflater, uint8_t* out, size_t size);
+
+END_EXTERN_C
+
+#endif
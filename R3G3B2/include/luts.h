@@ -20,9 +20,20 @@
 BEGIN_EXTERN_C
 
 #include "image_typedef.h"
+#include "constrains.h"
 
-int initialize_luts(float gamma, float contrast, float brightness, uint8_t* gamma_lut, uint8_t* contrast_brightness_lut);
-int process_image_with_luts(ImageData* image, const uint8_t* gamma_lut, const uint8_t* contrast_brightness_lut);
+// One 256-entry table per channel, the whole tone chain composed into a single lookup
+typedef struct {
+    uint8_t channel[RGB_COMPONENTS][LUT_SIZE];
+} ToneLut;
+
+void tone_lut_identity(ToneLut* lut);
+void tone_lut_compose(ToneLut* lut, const ToneLut* next); // lut becomes next applied after lut
+int load_curves_file(const char* filename, ToneLut* curves);
+
+// Gamma, then contrast and brightness, then the curves file if curves_filename is not empty
+int initialize_luts(float gamma, float contrast, float brightness, const char* curves_filename, ToneLut* lut);
+int process_image_with_luts(ImageData* image, const ToneLut* lut);
 
 END_EXTERN_C
 
@@ -0,0 +1,45 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef MAPPED_IMAGE_H
+#define MAPPED_IMAGE_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include "image_typedef.h"
+
+typedef struct MappedImage MappedImage;
+
+/*
+ * Maps an uncompressed image file read-only and describes where its rows are, so the kernels
+ * read pixels straight from the page cache with nothing decoded or copied. Handles 24 and 32-bit
+ * BMP (bottom-up or top-down, rows padded to 4 bytes), binary PPM/PGM with 8-bit samples and,
+ * when raw_width and raw_height are set, headerless RGB888 dumps.
+ *
+ * Returns NULL for files it cannot map; the caller then loads the file the usual way.
+ * Only raw dumps, which nothing else can load, report why.
+ */
+MappedImage* mapped_image_open(const char* filename, int raw_width, int raw_height);
+void mapped_image_close(MappedImage* image);
+
+const PixelLayout* mapped_image_layout(const MappedImage* image);
+
+// Faults the whole file in now, so the pass that reads the pixels later does not wait on the disk
+void mapped_image_prefetch(const MappedImage* image);
+
+END_EXTERN_C
+
+#endif
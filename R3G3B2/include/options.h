@@ -25,6 +25,25 @@ BEGIN_EXTERN_C
 
 #define MAX_FILENAME_LENGTH 1024
 
+// How -h output spells the pixel array
+typedef enum {
+    HEADER_ENCODING_BYTES = 0, // One 0xNN, token per pixel
+    HEADER_ENCODING_STRING,    // Escaped string literals, one per image row
+    HEADER_ENCODING_WORDS,     // uint32_t words, four pixels each, little-endian
+    HEADER_ENCODING_EMBED      // C23 #embed of a raw pixel file written next to the header
+} HeaderEncoding;
+
+// Target of -elf output
+typedef enum {
+    ELF_ARCH_NONE = 0,
+    ELF_ARCH_X86,
+    ELF_ARCH_X86_64,
+    ELF_ARCH_ARM,
+    ELF_ARCH_AARCH64,
+    ELF_ARCH_RISCV32,
+    ELF_ARCH_RISCV64
+} ElfArch;
+
 // In options.h
 typedef struct {
     char infilename[MAX_FILENAME_LENGTH];
@@ -36,8 +55,30 @@ typedef struct {
     bool debug_mode;
     char debug_filename[MAX_FILENAME_LENGTH];
     char palette_filename[MAX_FILENAME_LENGTH];
+    char curves_filename[MAX_FILENAME_LENGTH]; // Per-channel tone curves, empty for none
     bool header_output; // Flag for header output
     bool bin_output;    // Flag for binary output
+    HeaderEncoding header_encoding;
+    ElfArch elf_arch;   // -elf: write a relocatable object for this target, ELF_ARCH_NONE otherwise
+    bool asm_output;    // -asm: write a GNU assembler file that .incbin's the pixels
+    char symbol_name[MAX_FILENAME_LENGTH]; // Prefix of the generated symbols, empty for the output file name
+    bool split_source;  // -h data goes to a .c file, the header keeps extern declarations
+    char data_section[MAX_FILENAME_LENGTH]; // Linker section for the pixel array, empty for the default
+    int data_alignment; // Alignment of the pixel array in bytes, 0 for the default
+    bool self_test;     // Run the quantizer self-test and exit
+    int threads;        // Worker threads, 0 for one per CPU
+    bool channel_diffusion; // Diffuse R, G and B as independent planes
+    bool stream_mode;   // Convert row by row without holding the whole image
+    int raw_width;      // -raw: the input is headerless RGB888 of this size, 0 otherwise
+    int raw_height;
+    bool verbose;       // Report output size and write throughput
+    char cache_directory[MAX_FILENAME_LENGTH]; // -cache: reuse earlier outputs from here, empty for none
+    long cache_size_mib; // Size the cache is trimmed to
+    bool cache_stats;   // Print the cache statistics and exit
+    bool if_changed;    // Leave outputs whose bytes would not change untouched
+    char batch_source[MAX_FILENAME_LENGTH]; // -batch: directory, glob or list file of inputs; -o is then a directory
+    int pipeline_threads[3]; // -pipeline: decode, process and write threads of a batch, all 0 for a worker per file
+    int queue_depth;    // Images waiting between two pipeline stages
 } ProgramOptions;
 
 
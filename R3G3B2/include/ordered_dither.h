@@ -0,0 +1,55 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef ORDERED_DITHER_H
+#define ORDERED_DITHER_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image_typedef.h"
+#include "thread_pool.h"
+#include "luts.h"
+
+typedef struct OrderedDither OrderedDither;
+
+// How far a threshold t moves a channel value
+typedef enum {
+    ORDERED_SPREAD_FIXED = 0,  // (t - 128) / 8 on every channel, as the Bayer path always has
+    ORDERED_SPREAD_LEVEL_STEP  // Up to half the channel's palette step either way
+} OrderedSpread;
+
+// matrix is size x size thresholds (0-255), size a power of two of at least 16.
+// lut is applied to each channel before the threshold; NULL means none.
+OrderedDither* ordered_dither_create(const uint8_t* matrix, int size, OrderedSpread spread, const ToneLut* lut);
+void ordered_dither_free(OrderedDither* dither);
+
+// Dithers and quantizes an RGB image in place, leaving an indexed image
+int ordered_dither_image(ImageData* image, ThreadPool* pool, const OrderedDither* dither, const char* name);
+
+// One row of indices (an IndexRowFunc); context is the OrderedDither
+void ordered_dither_row(const uint8_t* src, uint8_t* dst, int y, int width, const void* context);
+
+// true when ordered_dither_row runs SSSE3 code on this build and CPU
+bool ordered_dither_simd_available(void);
+// Exact-match check of the SSSE3 rows against the scalar ones, returns mismatches (-1 on failure)
+long verify_ordered_simd(void);
+
+END_EXTERN_C
+
+#endif
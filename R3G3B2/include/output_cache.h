@@ -0,0 +1,58 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stdint.h>
+
+#include "options.h"
+#include "fileio.h"
+
+// Default -cache-size, in MiB
+#define OUTPUT_CACHE_DEFAULT_MIB 1024
+
+/*
+ * A local directory of finished outputs, keyed by a hash of the input file's bytes, the options
+ * that change the output (file names included, as they appear in the text) and R3G3B2_VERSION.
+ * Entry files are <key>.<n>, one per output file; a hit copies (or reflinks) them into place and
+ * refreshes their times, and stores evict the least recently used files beyond the size cap.
+ */
+typedef struct {
+    char directory[MAX_FILENAME_LENGTH];
+    char key[17];
+    char outputs[MAX_OUTPUT_FILES][MAX_FILENAME_LENGTH];
+    int output_count;
+    bool if_changed;    // Restore only the outputs whose bytes differ
+} OutputCache;
+
+// Hashes the input and curves files; EXIT_FAILURE when they cannot be read or the names do not fit
+int output_cache_open(OutputCache* cache, const ProgramOptions* opts, const char* array_name, const OutputFormat* format);
+
+// EXIT_SUCCESS when every output was restored from the cache; bytes receives their total size
+int output_cache_restore(const OutputCache* cache, size_t* bytes);
+
+// Copies the outputs just written into the cache, then trims it to size_mib
+int output_cache_store(const OutputCache* cache, long size_mib);
+
+// Hit rate, bytes served from the cache and the size of the directory
+int output_cache_print_stats(const char* directory);
+
+END_EXTERN_C
+
+#endif
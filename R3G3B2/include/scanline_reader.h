@@ -0,0 +1,49 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef SCANLINE_READER_H
+#define SCANLINE_READER_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image_typedef.h"
+
+typedef struct ScanlineReader ScanlineReader;
+
+/*
+ * Decodes an image one row at a time, top to bottom, as RGB888. BMP, PPM/PGM, PAM, TGA and
+ * non-interlaced PNG are read straight from the file with memory for a few rows; anything else
+ * stb_image can load is decoded whole and then handed out row by row.
+ */
+ScanlineReader* scanline_reader_open(const char* filename);
+void scanline_reader_close(ScanlineReader* reader);
+
+int scanline_reader_width(const ScanlineReader* reader);
+int scanline_reader_height(const ScanlineReader* reader);
+bool scanline_reader_is_streaming(const ScanlineReader* reader);
+
+// Fills rgb with the next row (width * 3 bytes)
+int scanline_reader_read_row(ScanlineReader* reader, uint8_t* rgb);
+
+// Reads every remaining row into a new RGB888 image
+int scanline_reader_read_image(ScanlineReader* reader, ImageData* image);
+
+END_EXTERN_C
+
+#endif
@@ -0,0 +1,57 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#if defined (__cplusplus)
+#define BEGIN_EXTERN_C extern "C" {
+#define END_EXTERN_C }
+#else
+#define BEGIN_EXTERN_C
+#define END_EXTERN_C
+#endif
+
+BEGIN_EXTERN_C
+
+typedef struct ThreadPool ThreadPool;
+
+// Runs once on every worker; worker_index is 0..thread_count-1, worker 0 is the calling thread
+typedef void (*ThreadTask)(void* context, int worker_index);
+
+int cpu_count(void);
+
+ThreadPool* thread_pool_create(int thread_count);
+void thread_pool_destroy(ThreadPool* pool);
+int thread_pool_size(const ThreadPool* pool);
+void thread_pool_run(ThreadPool* pool, ThreadTask task, void* context);
+
+/*
+ * A bounded FIFO of pointers between threads. push waits while it is full and pop while it is
+ * empty; once closed, pop hands out what is left and then returns NULL, and push refuses.
+ */
+typedef struct WorkQueue WorkQueue;
+
+WorkQueue* work_queue_create(int capacity);
+void work_queue_destroy(WorkQueue* queue);
+int work_queue_push(WorkQueue* queue, void* item); // EXIT_FAILURE once closed
+void* work_queue_pop(WorkQueue* queue);
+void work_queue_close(WorkQueue* queue);
+
+// Lock-free helpers for progress counters shared between workers
+int pool_load_acquire(const volatile int* value);
+void pool_store_release(volatile int* value, int new_value);
+int pool_atomic_fetch_add(volatile int* value, int addend);
+void pool_yield(void);
+
+// Monotonic time in seconds, for measuring intervals
+double wall_clock_seconds(void);
+
+END_EXTERN_C
+
+#endif
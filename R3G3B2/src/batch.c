@@ -0,0 +1,551 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "batch.h"
+#include "image_process.h"
+#include "thread_pool.h"
+#include "fileio.h"
+#include "error.h"
+
+// One input and the file it converts to, both malloc'd
+typedef struct {
+    char* input;
+    char* output;
+} BatchEntry;
+
+typedef struct {
+    BatchEntry* entries;
+    size_t count;
+    size_t capacity;
+} BatchList;
+
+typedef struct {
+    const ProgramOptions* opts;
+    const ToneLut* lut;
+    const BatchList* list;
+    ConvertWorker* workers;  // One per pool thread, indexed by worker_index
+    volatile int next;       // Next entry to hand out
+    volatile int failed;
+} BatchJob;
+
+// One image's way through the stages; the StagedImage keeps its buffers for the next
+typedef struct {
+    StagedImage* image;
+    int entry;               // Index into the batch list
+} PipelineSlot;
+
+typedef struct {
+    const ProgramOptions* opts;
+    const ToneLut* lut;
+    const BatchList* list;
+    WorkQueue* free_slots;   // Slots no image is using
+    WorkQueue* decoded;      // Decoded, waiting to be processed
+    WorkQueue* processed;    // Indexed, waiting to be written
+    volatile int next;       // Next entry to decode
+    volatile int decoders_left;
+    volatile int processors_left;
+    volatile int failed;
+} Pipeline;
+
+static char* copy_string(const char* text)
+{
+    const size_t size = strlen(text) + 1;
+    char* copy = (char*)malloc(size);
+    if (copy) {
+        memcpy(copy, text, size);
+    }
+    return copy;
+}
+
+static int add_input(BatchList* list, const char* input)
+{
+    if (strlen(input) >= MAX_FILENAME_LENGTH) {
+        return fileio_error("Batch input file name is too long.");
+    }
+    if (list->count == list->capacity) {
+        const size_t grown_capacity = list->capacity ? list->capacity * 2 : 256;
+        BatchEntry* grown = (BatchEntry*)realloc(list->entries, grown_capacity * sizeof(BatchEntry));
+        if (!grown) {
+            return fileio_error("Failed to allocate batch list.");
+        }
+        list->entries = grown;
+        list->capacity = grown_capacity;
+    }
+    BatchEntry* entry = &list->entries[list->count];
+    entry->input = copy_string(input);
+    entry->output = NULL;
+    if (!entry->input) {
+        return fileio_error("Failed to allocate batch list.");
+    }
+    list->count++;
+    return EXIT_SUCCESS;
+}
+
+static void free_batch_list(BatchList* list)
+{
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->entries[i].input);
+        free(list->entries[i].output);
+    }
+    free(list->entries);
+    memset(list, 0, sizeof(BatchList));
+}
+
+static bool is_directory(const char* path)
+{
+#if defined(_WIN32)
+    const DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat status;
+    return stat(path, &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+}
+
+// directory and name with a separator between them; false if it does not fit
+static bool join_path(const char* directory, const char* name, char* dest, size_t dest_size)
+{
+    const size_t length = strlen(directory);
+    const bool separated = length == 0 || directory[length - 1] == '/' || directory[length - 1] == '\\';
+    const int written = snprintf(dest, dest_size, "%s%s%s", directory, separated ? "" : "/", name);
+    return written >= 0 && (size_t)written < dest_size;
+}
+
+// Every regular file of directory but the dot files
+static int list_directory(const char* directory, BatchList* list)
+{
+    char path[MAX_FILENAME_LENGTH];
+    int result = EXIT_SUCCESS;
+
+#if defined(_WIN32)
+    char pattern[MAX_FILENAME_LENGTH];
+    if (!join_path(directory, "*", pattern, sizeof(pattern))) {
+        return fileio_error("Batch directory name is too long.");
+    }
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return fileio_error("Failed to list batch directory.");
+    }
+    do {
+        if (found.cFileName[0] == '.' || (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+        if (!join_path(directory, found.cFileName, path, sizeof(path))) {
+            result = fileio_error("Batch input file name is too long.");
+            break;
+        }
+        if ((result = add_input(list, path)) != EXIT_SUCCESS) break;
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR* dir = opendir(directory);
+    if (!dir) {
+        return fileio_perror("Failed to list batch directory");
+    }
+    for (struct dirent* entry; (entry = readdir(dir)) != NULL; ) {
+        struct stat status;
+        if (entry->d_name[0] == '.') continue;
+        if (!join_path(directory, entry->d_name, path, sizeof(path))) {
+            result = fileio_error("Batch input file name is too long.");
+            break;
+        }
+        if (stat(path, &status) != 0 || !S_ISREG(status.st_mode)) continue;
+        if ((result = add_input(list, path)) != EXIT_SUCCESS) break;
+    }
+    closedir(dir);
+#endif
+    return result;
+}
+
+// The files a wildcard pattern matches; no match is an empty list
+static int list_pattern(const char* pattern, BatchList* list)
+{
+    int result = EXIT_SUCCESS;
+
+#if defined(_WIN32)
+    // FindFirstFileA only expands the last component and returns bare names
+    char path[MAX_FILENAME_LENGTH];
+    const int directory_length = (int)(base_name(pattern) - pattern);
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return EXIT_SUCCESS;
+    }
+    do {
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        const int written = snprintf(path, sizeof(path), "%.*s%s", directory_length, pattern, found.cFileName);
+        if (written < 0 || (size_t)written >= sizeof(path)) {
+            result = fileio_error("Batch input file name is too long.");
+            break;
+        }
+        if ((result = add_input(list, path)) != EXIT_SUCCESS) break;
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    glob_t matches;
+    const int status = glob(pattern, 0, NULL, &matches);
+    if (status == GLOB_NOMATCH) {
+        return EXIT_SUCCESS;
+    }
+    if (status != 0) {
+        return fileio_error("Failed to expand batch pattern.");
+    }
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+        if (is_directory(matches.gl_pathv[i])) continue;
+        if ((result = add_input(list, matches.gl_pathv[i])) != EXIT_SUCCESS) break;
+    }
+    globfree(&matches);
+#endif
+    return result;
+}
+
+// One path per line; blank lines and lines starting with '#' are skipped
+static int list_file(const char* filename, BatchList* list)
+{
+    FILE* fp = fopen(filename, "r");
+    if (!fp) {
+        return fileio_perror("Failed to open batch list");
+    }
+
+    char line[MAX_FILENAME_LENGTH + 2];
+    int result = EXIT_SUCCESS;
+    while (fgets(line, sizeof(line), fp)) {
+        size_t length = strlen(line);
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n') {
+            result = fileio_error("Batch list line is too long.");
+            break;
+        }
+        while (length > 0 && isspace((unsigned char)line[length - 1])) {
+            line[--length] = '\0';
+        }
+        const char* path = line;
+        while (isspace((unsigned char)*path)) path++;
+        if (*path == '\0' || *path == '#') continue;
+        if ((result = add_input(list, path)) != EXIT_SUCCESS) break;
+    }
+    if (result == EXIT_SUCCESS && ferror(fp)) {
+        result = fileio_perror("Failed to read batch list");
+    }
+    fclose(fp);
+    return result;
+}
+
+static int collect_inputs(const char* source, BatchList* list)
+{
+    if (is_directory(source)) {
+        return list_directory(source, list);
+    }
+    if (strpbrk(source, "*?[") != NULL) {
+        return list_pattern(source, list);
+    }
+    return list_file(source, list);
+}
+
+static const char* output_extension(const ProgramOptions* opts)
+{
+    if (opts->bin_output) return ".bin";
+    if (opts->elf_arch != ELF_ARCH_NONE) return ".o";
+    if (opts->asm_output) return ".S";
+    return ".h";
+}
+
+static int compare_strings(const void* first, const void* second)
+{
+    return strcmp(*(const char* const*)first, *(const char* const*)second);
+}
+
+// Sorts names; each name that appears more than once is reported as what more than one input would do
+static int report_duplicates(const char** names, size_t count, const char* what)
+{
+    qsort(names, count, sizeof(const char*), compare_strings);
+    int result = EXIT_SUCCESS;
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(names[i - 1], names[i]) == 0) {
+            fprintf(stderr, "Error: More than one batch input would %s %s\n", what, names[i]);
+            result = EXIT_FAILURE;
+        }
+    }
+    return result;
+}
+
+// "<directory>/<input name><extension>", the input's own extension dropped; two inputs may share
+// neither an output nor the array name it gives, or their objects would not link together
+static int name_outputs(BatchList* list, const char* directory, const char* extension)
+{
+    char name[MAX_FILENAME_LENGTH];
+    char path[MAX_FILENAME_LENGTH];
+    for (size_t i = 0; i < list->count; i++) {
+        const char* input_name = base_name(list->entries[i].input);
+        const char* dot = strrchr(input_name, '.');
+        const int stem_length = (int)((dot && dot != input_name) ? (size_t)(dot - input_name) : strlen(input_name));
+        const int written = snprintf(name, sizeof(name), "%.*s%s", stem_length, input_name, extension);
+        if (written < 0 || (size_t)written >= sizeof(name) || !join_path(directory, name, path, sizeof(path))) {
+            return fileio_error("Batch output file name is too long.");
+        }
+        list->entries[i].output = copy_string(path);
+        if (!list->entries[i].output) {
+            return fileio_error("Failed to allocate batch list.");
+        }
+    }
+
+    const char** names = (const char**)malloc((list->count + 1) * sizeof(const char*));
+    char (*symbols)[MAX_FILENAME_LENGTH] = (char (*)[MAX_FILENAME_LENGTH])malloc((list->count + 1) * MAX_FILENAME_LENGTH);
+    if (!names || !symbols) {
+        free(names);
+        free(symbols);
+        return fileio_error("Failed to allocate batch list.");
+    }
+    int result = EXIT_SUCCESS;
+    for (size_t i = 0; i < list->count && result == EXIT_SUCCESS; i++) {
+        names[i] = list->entries[i].output;
+        result = symbol_from_filename(list->entries[i].output, symbols[i], MAX_FILENAME_LENGTH);
+    }
+    if (result == EXIT_SUCCESS) {
+        result = report_duplicates(names, list->count, "write");
+        for (size_t i = 0; i < list->count; i++) {
+            names[i] = symbols[i];
+        }
+        if (report_duplicates(names, list->count, "use the symbol") != EXIT_SUCCESS) {
+            result = EXIT_FAILURE;
+        }
+    }
+    free(symbols);
+    free(names);
+    return result;
+}
+
+static void batch_task(void* context, int worker_index)
+{
+    BatchJob* job = (BatchJob*)context;
+    ProgramOptions opts = *job->opts;
+
+    for (;;) {
+        const int index = pool_atomic_fetch_add(&job->next, 1);
+        if (index >= (int)job->list->count) break;
+
+        const BatchEntry* entry = &job->list->entries[index];
+        strcpy(opts.infilename, entry->input);
+        strcpy(opts.outfilename, entry->output);
+        if (convert_file(&opts, job->lut, &job->workers[worker_index]) != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: Failed to convert %s\n", entry->input);
+            pool_atomic_fetch_add(&job->failed, 1);
+        }
+    }
+}
+
+// Each pool thread converts whole files, one at a time
+static int run_workers(const ProgramOptions* opts, const ToneLut* lut, const BatchList* list, int* failed, int* thread_count)
+{
+    ThreadPool* pool = thread_pool_create(opts->threads);
+    const int worker_count = thread_pool_size(pool);
+    ConvertWorker* workers = (ConvertWorker*)calloc(worker_count, sizeof(ConvertWorker));
+    if (!workers) {
+        thread_pool_destroy(pool);
+        return fileio_error("Failed to allocate batch workers.");
+    }
+    // Every worker already has a file of its own; only a batch smaller than the pool splits the images
+    const int image_threads = (list->count < (size_t)worker_count) ? worker_count / (int)list->count : 1;
+    for (int i = 0; i < worker_count; i++) {
+        workers[i].threads = image_threads;
+    }
+
+    BatchJob job = { opts, lut, list, workers, 0, 0 };
+    thread_pool_run(pool, batch_task, &job);
+    thread_pool_destroy(pool);
+
+    for (int i = 0; i < worker_count; i++) {
+        convert_worker_release(&workers[i]);
+    }
+    free(workers);
+    *failed = job.failed;
+    *thread_count = worker_count;
+    return EXIT_SUCCESS;
+}
+
+static void pipeline_failed(Pipeline* pipeline, PipelineSlot* slot)
+{
+    fprintf(stderr, "Error: Failed to convert %s\n", pipeline->list->entries[slot->entry].input);
+    pool_atomic_fetch_add(&pipeline->failed, 1);
+    work_queue_push(pipeline->free_slots, slot);
+}
+
+static void decode_loop(Pipeline* pipeline)
+{
+    ProgramOptions opts = *pipeline->opts;
+
+    for (;;) {
+        const int index = pool_atomic_fetch_add(&pipeline->next, 1);
+        if (index >= (int)pipeline->list->count) break;
+
+        // Waits here while every slot is in flight, which is what bounds the memory
+        PipelineSlot* slot = (PipelineSlot*)work_queue_pop(pipeline->free_slots);
+        bool pending = false;
+        slot->entry = index;
+        strcpy(opts.infilename, pipeline->list->entries[index].input);
+        strcpy(opts.outfilename, pipeline->list->entries[index].output);
+        if (stage_decode(slot->image, &opts, &pending) != EXIT_SUCCESS) {
+            pipeline_failed(pipeline, slot);
+        }
+        else {
+            work_queue_push(pending ? pipeline->decoded : pipeline->free_slots, slot);
+        }
+    }
+    // The last decoder out tells the process stage that nothing more is coming
+    if (pool_atomic_fetch_add(&pipeline->decoders_left, -1) == 1) {
+        work_queue_close(pipeline->decoded);
+    }
+}
+
+static void process_loop(Pipeline* pipeline)
+{
+    for (PipelineSlot* slot; (slot = (PipelineSlot*)work_queue_pop(pipeline->decoded)) != NULL; ) {
+        if (stage_process(slot->image, pipeline->lut) != EXIT_SUCCESS) {
+            pipeline_failed(pipeline, slot);
+        }
+        else {
+            work_queue_push(pipeline->processed, slot);
+        }
+    }
+    if (pool_atomic_fetch_add(&pipeline->processors_left, -1) == 1) {
+        work_queue_close(pipeline->processed);
+    }
+}
+
+static void write_loop(Pipeline* pipeline)
+{
+    for (PipelineSlot* slot; (slot = (PipelineSlot*)work_queue_pop(pipeline->processed)) != NULL; ) {
+        if (stage_write(slot->image) != EXIT_SUCCESS) {
+            pipeline_failed(pipeline, slot);
+        }
+        else {
+            work_queue_push(pipeline->free_slots, slot);
+        }
+    }
+}
+
+// Pool threads are handed out to the stages in order: decoders, then processors, then writers
+static void pipeline_task(void* context, int worker_index)
+{
+    Pipeline* pipeline = (Pipeline*)context;
+    const int decode_threads = pipeline->opts->pipeline_threads[0];
+    const int process_threads = pipeline->opts->pipeline_threads[1];
+
+    if (worker_index < decode_threads) {
+        decode_loop(pipeline);
+    }
+    else if (worker_index < decode_threads + process_threads) {
+        process_loop(pipeline);
+    }
+    else {
+        write_loop(pipeline);
+    }
+}
+
+static int run_pipeline(const ProgramOptions* opts, const ToneLut* lut, const BatchList* list, int* failed, int* thread_count)
+{
+    const int* threads = opts->pipeline_threads;
+    const int total_threads = threads[0] + threads[1] + threads[2];
+    // A slot is either being worked on by a stage thread or waiting in one of the two queues
+    const int slot_count = total_threads + 2 * opts->queue_depth;
+
+    Pipeline pipeline = { opts, lut, list, NULL, NULL, NULL, 0, threads[0], threads[1], 0 };
+    PipelineSlot* slots = (PipelineSlot*)calloc(slot_count, sizeof(PipelineSlot));
+    pipeline.free_slots = work_queue_create(slot_count);
+    pipeline.decoded = work_queue_create(opts->queue_depth);
+    pipeline.processed = work_queue_create(opts->queue_depth);
+    ThreadPool* pool = thread_pool_create(total_threads);
+
+    int result = EXIT_SUCCESS;
+    if (!slots || !pipeline.free_slots || !pipeline.decoded || !pipeline.processed || thread_pool_size(pool) != total_threads) {
+        result = fileio_error("Failed to start the batch pipeline.");
+    }
+    for (int i = 0; result == EXIT_SUCCESS && i < slot_count; i++) {
+        slots[i].image = staged_image_create();
+        if (!slots[i].image) {
+            result = fileio_error("Failed to allocate batch pipeline slots.");
+            break;
+        }
+        work_queue_push(pipeline.free_slots, &slots[i]);
+    }
+
+    if (result == EXIT_SUCCESS) {
+        thread_pool_run(pool, pipeline_task, &pipeline);
+        *failed = pipeline.failed;
+        *thread_count = total_threads;
+    }
+
+    thread_pool_destroy(pool);
+    for (int i = 0; slots && i < slot_count; i++) {
+        staged_image_free(slots[i].image);
+    }
+    free(slots);
+    work_queue_destroy(pipeline.processed);
+    work_queue_destroy(pipeline.decoded);
+    work_queue_destroy(pipeline.free_slots);
+    return result;
+}
+
+int process_batch(const ProgramOptions* opts)
+{
+    if (!opts) {
+        return fileio_error("Null pointer passed to process_batch.");
+    }
+    if (opts->outfilename[0] == '\0') {
+        return fileio_error("-batch needs -o <directory> for the outputs.");
+    }
+    if (!opts->header_output && !opts->bin_output && opts->elf_arch == ELF_ARCH_NONE && !opts->asm_output) {
+        return fileio_error("Must select -b, -h, -elf or -asm output option");
+    }
+    if (!make_directory(opts->outfilename)) {
+        return fileio_perror("Failed to create output directory");
+    }
+
+    BatchList list = { 0 };
+    ToneLut lut;
+    int result = collect_inputs(opts->batch_source, &list);
+    if (result == EXIT_SUCCESS && list.count == 0) {
+        result = fileio_error("-batch found no input files.");
+    }
+    if (result == EXIT_SUCCESS) {
+        result = name_outputs(&list, opts->outfilename, output_extension(opts));
+    }
+    if (result == EXIT_SUCCESS) {
+        result = prepare_conversion(opts, &lut);
+    }
+
+    const double start = wall_clock_seconds();
+    int failed = 0;
+    int thread_count = 0;
+    if (result == EXIT_SUCCESS) {
+        result = (opts->pipeline_threads[0] > 0) ? run_pipeline(opts, &lut, &list, &failed, &thread_count)
+                                                 : run_workers(opts, &lut, &list, &failed, &thread_count);
+    }
+    if (result == EXIT_SUCCESS && opts->verbose) {
+        printf("Converted %zu of %zu files in %.2f s on %d threads\n", list.count - (size_t)failed, list.count,
+               wall_clock_seconds() - start, thread_count);
+    }
+    free_batch_list(&list);
+    return (result == EXIT_SUCCESS && failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
  *                                                       *
  *********************************************************/
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
 
 #include "constrains.h"
@@ -43,23 +44,126 @@ static float calculateWeightedDistance(uint8_t r1, uint8_t g1, uint8_t b1, uint8
     return sqrtf(wr * dr * dr + wg * dg * dg + wb * db * db);
 }
 
-// using weighted euclidean distance
-void quantize_pixel_with_map_reduced(uint8_t* r, uint8_t* g, uint8_t* b)
+// Reference search over the whole palette using weighted euclidean distance
+uint8_t find_nearest_palette_index_search(uint8_t r, uint8_t g, uint8_t b)
 {
     float minDistance = INFINITY;
     int   closestIndex = 0;
 
     for (int i = 0; i < R3G3B2_COLOR_COUNT; i++) {
-        float distance = calculateWeightedDistance(*r, *g, *b, r3g3b2Palette[i].r, r3g3b2Palette[i].g, r3g3b2Palette[i].b);
+        float distance = calculateWeightedDistance(r, g, b, r3g3b2Palette[i].r, r3g3b2Palette[i].g, r3g3b2Palette[i].b);
         if (distance < minDistance) {
             minDistance = distance;
             closestIndex = i;
         }
     }
+    return (uint8_t)closestIndex;
+}
+
+/*
+ * The palette is the Cartesian product of RED_LEVELS x GREEN_LEVELS x BLUE_LEVELS and the
+ * weighted distance is a sum of independent per-channel terms, so the nearest entry is
+ * made of the nearest level in each channel. Ties go to the lower level, which is the
+ * entry the full search meets first.
+ */
+static uint8_t channelLevelIndex[RGB_COMPONENTS][LUT_SIZE];
+static uint8_t channelLevelValue[RGB_COMPONENTS][RED_LEVELS];
+static int     channelQuantizerReady = 0;
+
+const int channelIndexShift[RGB_COMPONENTS] = { RED_INDEX_SHIFT, GREEN_INDEX_SHIFT, BLUE_INDEX_SHIFT };
+
+// How far one level step moves the palette index, per channel
+static const int channelIndexStride[RGB_COMPONENTS] = { 1 << RED_INDEX_SHIFT, 1 << GREEN_INDEX_SHIFT, 1 << BLUE_INDEX_SHIFT };
+
+static void build_channel_table(int channel, int levels, int palette_stride)
+{
+    for (int k = 0; k < levels; k++) {
+        const RGBColor* p = &r3g3b2Palette[k * palette_stride];
+        channelLevelValue[channel][k] = (channel == 0) ? p->r : (channel == 1) ? p->g : p->b;
+    }
+
+    for (int v = 0; v < LUT_SIZE; v++) {
+        int best = 0;
+        int bestDistance = abs(v - channelLevelValue[channel][0]);
+        for (int k = 1; k < levels; k++) {
+            int distance = abs(v - channelLevelValue[channel][k]);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        channelLevelIndex[channel][v] = (uint8_t)best;
+    }
+}
+
+int initialize_channel_quantizer(void)
+{
+    if (channelQuantizerReady) return EXIT_SUCCESS;
+
+    build_channel_table(0, RED_LEVELS, channelIndexStride[0]);
+    build_channel_table(1, GREEN_LEVELS, channelIndexStride[1]);
+    build_channel_table(2, BLUE_LEVELS, channelIndexStride[2]);
+    channelQuantizerReady = 1;
+    return EXIT_SUCCESS;
+}
+
+uint8_t palette_channel_level(int channel, uint8_t value)
+{
+    return channelLevelIndex[channel][value];
+}
+
+uint8_t palette_level_value(int channel, uint8_t level)
+{
+    return channelLevelValue[channel][level];
+}
+
+// table[v] is the part of the palette index channel contributes for input v, after lut (NULL for none)
+void build_index_contribution_table(int channel, const uint8_t* lut, uint8_t* table)
+{
+    initialize_channel_quantizer();
+    for (int v = 0; v < LUT_SIZE; v++) {
+        const uint8_t value = lut ? lut[v] : (uint8_t)v;
+        table[v] = (uint8_t)(channelLevelIndex[channel][value] * channelIndexStride[channel]);
+    }
+}
 
-    *r = r3g3b2Palette[closestIndex].r;
-    *g = r3g3b2Palette[closestIndex].g;
-    *b = r3g3b2Palette[closestIndex].b;
+uint8_t nearest_palette_index_separable(uint8_t r, uint8_t g, uint8_t b)
+{
+    return (uint8_t)((channelLevelIndex[0][r] << RED_INDEX_SHIFT) | (channelLevelIndex[1][g] << GREEN_INDEX_SHIFT) |
+                     (channelLevelIndex[2][b] << BLUE_INDEX_SHIFT));
+}
+
+void quantize_pixel_separable(uint8_t* r, uint8_t* g, uint8_t* b)
+{
+    *r = channelLevelValue[0][channelLevelIndex[0][*r]];
+    *g = channelLevelValue[1][channelLevelIndex[1][*g]];
+    *b = channelLevelValue[2][channelLevelIndex[2][*b]];
+}
+
+void palette_index_to_rgb(uint8_t index, uint8_t* r, uint8_t* g, uint8_t* b)
+{
+    *r = r3g3b2Palette[index].r;
+    *g = r3g3b2Palette[index].g;
+    *b = r3g3b2Palette[index].b;
+}
+
+// Exhaustive check of the separable quantizer against the full palette search, returns the number of mismatches
+long verify_separable_quantizer(void)
+{
+    long mismatches = 0;
+
+    initialize_channel_quantizer();
+    for (int r = 0; r <= MAX_COLOUR_VALUE; r++) {
+        for (int g = 0; g <= MAX_COLOUR_VALUE; g++) {
+            for (int b = 0; b <= MAX_COLOUR_VALUE; b++) {
+                if (nearest_palette_index_separable((uint8_t)r, (uint8_t)g, (uint8_t)b) !=
+                    find_nearest_palette_index_search((uint8_t)r, (uint8_t)g, (uint8_t)b)) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
 }
 
 uint8_t rgbToRgb332(uint8_t r, uint8_t g, uint8_t b)
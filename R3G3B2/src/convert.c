@@ -0,0 +1,52 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "constrains.h"
+#include "color.h"
+#include "dither.h"
+#include "fileio.h"
+#include "convert.h"
+#include "error.h"
+
+// The no-dither and ordered-dither paths only look at one pixel at a time, so the LUT,
+// quantization and RGB332 packing can run in a single sweep over the decoded image.
+// Indices are written in place to the front of the buffer, which then becomes an indexed image.
+bool is_fused_dither_method(int dither_method)
+{
+    switch (dither_method) {
+    case DITHER_FLOYD_STEINBERG:
+    case DITHER_JARVIS:
+    case DITHER_ATKINSON:
+        return false;
+    default:
+        return true;
+    }
+}
+
+int fused_convert_image(ImageData* image, const ToneLut* lut, int dither_method, ThreadPool* pool)
+{
+    if (!image || !image->data || !lut) {
+        return fileio_error("Null pointer passed to fused_convert_image.");
+    }
+
+    if (image->format != PIXEL_FORMAT_RGB888) {
+        return fileio_error("fused_convert_image needs an RGB image.");
+    }
+
+    if (!is_fused_dither_method(dither_method)) {
+        return fileio_error("Dither method cannot run in fused mode.");
+    }
+
+    // Both table engines take the LUT in, so it costs nothing per pixel
+    if (dither_method != DITHER_BAYER_16X16 && dither_method != DITHER_BLUE_NOISE) {
+        return index_table_convert(image, pool, lut, "fused_convert_image");
+    }
+    return ordered_dither_method(image, pool, dither_method, lut);
+}
\ No newline at end of file
@@ -5,7 +5,10 @@
  * http://creativecommons.org/publicdomain/zero/1.0/     *
  *                                                       *
  *********************************************************/
+#include <stdint.h>
+
 #include "fileio.h"
+#include "color.h"
 #include "constrains.h"
 #include "debug.h"
 #include "error.h"
@@ -26,7 +29,20 @@ int write_debug_image(const char* file_ext, const ImageData* image, const Progra
         if (snprintf_result < 0 || snprintf_result >= MAX_FILENAME_LENGTH) {
             return fileio_error("Could not create debug filename.");
         }
-        if (!stbi_write_bmp(processed_filename, image->width, image->height, RGB_COMPONENTS, image->data))
+        if (image->format == PIXEL_FORMAT_INDEXED8) {
+            size_t pixel_count = (size_t)image->width * image->height;
+            uint8_t* rgb = (uint8_t*)malloc(pixel_count * RGB_COMPONENTS + 1);
+            if (!rgb)
+                return fileio_error("Failed to allocate debug image buffer.");
+            for (size_t i = 0; i < pixel_count; i++) {
+                palette_index_to_rgb(image->data[i], &rgb[i * RGB_COMPONENTS], &rgb[i * RGB_COMPONENTS + 1], &rgb[i * RGB_COMPONENTS + 2]);
+            }
+            int written = stbi_write_bmp(processed_filename, image->width, image->height, RGB_COMPONENTS, rgb);
+            free(rgb);
+            if (!written)
+                return fileio_perror("Error writing debug image");
+        }
+        else if (!stbi_write_bmp(processed_filename, image->width, image->height, RGB_COMPONENTS, image->data))
             return fileio_perror("Error writing debug image");
     }
     return EXIT_SUCCESS;
@@ -5,13 +5,18 @@
  * http://creativecommons.org/publicdomain/zero/1.0/     *
  *                                                       *
  *********************************************************/
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "constrains.h"
 #include "dither.h"
+#include "fileio.h"
+#include "thread_pool.h"
+#include "ordered_dither.h"
 #include "error.h"
 
 static const uint8_t BAYER_MATRIX_16X16[BAYER_SIZE][BAYER_SIZE] = {
@@ -33,147 +38,926 @@ static const uint8_t BAYER_MATRIX_16X16[BAYER_SIZE][BAYER_SIZE] = {
     {255, 127, 223, 95, 247, 119, 215, 87, 253, 125, 221, 93, 245, 117, 213, 85}
 };
 
-static int genericDither(ImageData* image, const ErrorDiffusionEntry* matrix, int matrix_size)
+const uint8_t* bayer16x16_matrix(void)
 {
-    if (!image || !image->data) {
-        fileio_error("Null pointer passed to genericDither.");
-        return EXIT_FAILURE;
+    return &BAYER_MATRIX_16X16[0][0];
+}
+
+// Void-and-cluster ranks (Ulichney, gaussian sigma 1.5, wrapping edges) scaled to 0-255, each value 16 times
+static const uint8_t BLUE_NOISE_64X64[BLUE_NOISE_SIZE][BLUE_NOISE_SIZE] = {
+    {138,  57,  96, 131,   7, 103, 127,  75,  11, 119,  47,  87,  26, 223, 169,  17, 127, 232,   2, 211,  54, 115, 202, 138,  57, 191, 131, 251, 113, 171, 140, 188, 114, 164, 218,  97,  33, 228, 114, 161,  67, 144, 222, 191,  43, 204,   6, 230, 146,  63, 243,  91, 196,  13, 167, 146,  87, 244, 119, 203,  90, 162,  43, 119},
+    {195, 230,  31, 206,  68, 228, 157, 248,  93, 148, 208, 187, 140, 110, 202,  93,  55, 162,  76, 101, 226, 161,  26, 245, 106, 218,  18,  40,  86, 211,  72,  18, 226,  61, 127, 197,  70, 173,   3, 246,  99,  23, 116, 163,  91, 153, 110,  77, 188, 102,  23, 170,  51, 117, 254,  36, 215,   5, 171, 141,  13, 223,  64, 255},
+    {  2, 167, 147,  86, 178,  22,  52, 196,  28, 237,  69,   1, 234,  42,  66, 149, 219, 113, 254,  38, 146,  83, 186,  44, 169,  78, 147, 232, 157,  27, 245,  99, 147,  30, 253,  15, 142, 208,  83,  43, 199, 230,  57, 243,  69,  30, 254, 173,  15, 227, 199, 130, 223,  82, 188,  65, 131,  97,  41, 237, 109, 179, 151, 100},
+    { 76, 115,  48, 250, 118, 217, 139, 106, 169,  43, 132, 177,  99, 160, 246,   8, 193,  26, 184, 127,  12, 236,  66, 129,   1, 210, 115,  63, 196, 123,  51, 167, 207,  79, 177, 118,  53, 234, 109, 156, 134, 172,   5, 129, 185, 216, 137,  57, 124,  40, 154,  69,   7, 151,  24, 206, 159, 230, 191,  58,  79,  27, 204,  37},
+    {176, 233, 191,  25,  63, 166,   4,  79, 225, 115, 204,  81,  21, 215, 121,  84, 137,  49,  73, 167, 196,  97, 215, 154, 252,  52, 175,  11,  94, 224, 185,   2, 112,  43, 229,  92, 165,  30, 190,  16,  60,  88, 214,  41, 105,  17,  94, 202, 162,  89, 249, 108, 177, 240,  92, 112,  49,  17, 118, 149, 218, 124, 242, 136},
+    {211,  15,  93, 134, 205,  97, 246, 192,  62,  12, 254, 154,  54, 191,  35, 174, 230, 209, 110, 244,  58,  23, 113,  33,  88, 194, 137, 242,  42, 145,  76, 133, 221, 190, 151,   9, 245,  65, 127, 221, 253, 112, 193, 147, 239, 178,  45, 233,   0, 214,  59,  28, 208,  46, 138, 226, 180,  84, 246,  33, 186,   6,  87,  51},
+    {147,  69, 162, 236,  43, 152,  29, 122, 148, 185,  36, 104, 229, 140, 110,  64,  18,  94, 152,   3, 136, 226, 177, 205, 124,  18,  68, 104, 180,  20, 251,  53,  90,  27,  70, 134, 195,  97, 172,  78,  33, 161,  18,  80,  62, 157, 119,  78, 184, 114, 146, 191, 127,  77, 167,   2,  68, 208, 163,  97,  63, 165, 195, 109},
+    { 34, 222, 114,   9, 180,  75, 209,  50, 221,  92, 129, 176,  75,   5, 249, 197, 160, 237,  38, 204,  87, 159,  42,  71, 238, 166, 227, 153, 215, 118, 198, 150, 235, 171, 209, 106,  35, 215,   1, 145, 205,  51, 232, 131, 219,  10, 250, 143,  65,  35, 240,  10,  99, 216,  31, 252, 145, 125,  13, 219, 142, 251,  18, 232},
+    {171,  55, 189,  86, 130, 240, 107, 171,  21,  69, 243,  19, 217, 163,  92,  47, 128,  76, 181, 125,  65, 247, 106, 147,  27,  96,  49,   3,  85,  61,  33, 102,   7, 123,  50, 238, 155,  55, 246, 102, 181, 122,  92, 185,  36, 101, 200,  23, 225, 163,  83, 173, 231,  61, 188, 105,  41, 184,  56, 114,  36,  74, 129,  91},
+    {202, 137, 255,  23, 218,  58,   6, 138, 234, 201, 156,  53, 112, 203,  29, 147, 224,  12, 101, 217,  25, 198,   7, 186, 217, 130, 173, 202, 139, 244, 164, 188, 213,  82, 144,  21, 187,  84, 128,  23,  66, 239,   8, 211, 163,  58, 174,  86, 130, 204,  50, 116,  22, 129, 155,  87, 204, 238,  83, 230, 179, 209, 160,  25},
+    {107,  76,  41, 157,  96, 147, 194,  84, 117,  38,  96, 189, 135,  67, 243, 107, 170,  59, 255, 151,  49, 169, 134,  84,  44, 253,  73, 105, 229,  14, 128,  66,  42, 255, 179,  69, 114, 231, 199, 167, 217,  39, 149,  73, 112, 136, 241,  44, 106,  13, 253, 145, 196,  42, 242,  11, 121,  24, 166, 133,   8, 103,  51, 244},
+    {  1, 216, 120, 179, 206,  33, 248,  53, 184, 146,   1, 223,  33, 174,   8,  78, 200,  32, 187, 115,  90, 231,  62, 208, 112,  10, 193,  30,  56, 178,  92, 225, 151,  97,  13, 221, 164,   6,  44,  79, 138, 106, 176, 252,  25, 192,   5, 215, 149, 188,  64,  93, 221,  75, 166, 218,  71, 149,  45, 197,  64, 237, 127, 185},
+    {143,  53, 235,  11,  66, 116, 162,  14, 214,  73, 253, 120,  82, 231, 150, 215, 120, 138,  74,   1, 203, 124,  17, 163, 236, 152, 126, 161, 212, 116,  22, 197,  28, 117, 200, 135,  54, 104, 151, 248,  18, 196,  88,  50, 220,  68, 120, 168,  78, 227,  34, 179,   1, 107, 136,  49, 180, 249, 107, 216,  91, 151,  37,  84},
+    {161, 197,  93, 139, 242,  86, 221, 132, 101, 172,  45, 159, 197,  55, 100,  20,  49, 241, 223, 156,  42, 246, 184,  36,  68,  91,  49, 244,  70, 141, 238,  79, 168, 232,  38,  85, 241, 208, 187, 122,  60, 236,   3, 141, 158,  97, 238,  51,  19, 100, 126, 152, 247, 209,  22, 195,  86,   4, 130,  30, 181,  13, 206, 230},
+    { 17, 110,  39, 168,  24, 184,  37,  58, 235,  18, 208, 106,  10, 133, 250, 190, 165,  92,  22, 176, 102,  78, 144, 106, 226, 203,  14, 180, 100,   0, 185,  48, 132,  65, 153, 182,  15,  74,  25,  93, 171, 130, 212, 110, 185,  34, 198, 138, 208, 243, 170,  52,  83, 122,  62, 234, 103, 158, 225,  72, 245, 167, 114,  61},
+    {252, 176, 229,  75, 211, 147, 111, 199, 154,  89, 141,  67, 220, 177,  36,  72, 113, 209,  61, 131, 217,  54, 199,  21, 135, 169, 117, 219,  40, 158, 217, 111, 247,   9, 219, 106, 125, 168, 233,  43, 222,  29,  76,  46, 234,  12,  82, 162, 113,  67,  10, 202,  31, 182, 143, 168,  38, 205,  56, 145,  98,  46, 134,  81},
+    { 31, 136,  58, 125, 100,   2, 251,  71,  26, 183, 243,  31, 119,  88, 153, 230,   5, 144, 188,  34, 238,  12, 155, 249,  61,  34,  80, 143, 253,  60,  84,  25, 177,  95, 196,  34, 251,  55, 134, 199, 102, 150, 193, 167,  93, 132, 255,  46,  26, 189, 137, 236,  98, 221,  17,  76, 255,  14, 123, 193,  21, 222, 186, 213},
+    {103, 201,  12, 187, 223,  53, 166, 130, 224, 113,  52, 168, 232,  13, 202, 125,  46, 248,  83, 108, 167, 121,  88, 180, 101, 235, 187,  20, 109, 193, 129, 210, 150,  51,  72, 143, 207,  85, 159,   6,  68, 250,  16, 115, 219,  63, 175, 211,  96, 229,  77, 116, 159,  58, 198, 134, 109, 184,  87, 235, 157,  74,   3, 153},
+    { 87, 164, 246,  36, 156,  91, 193,  43,  85,   6, 200, 132,  77, 183,  59,  99, 212, 158,  20, 199,  62, 211,  40, 220,   3, 123, 208,  73, 169,   7, 228,  41, 119, 235, 165,   2, 102,  27, 230, 117, 183, 135,  53, 203,  32, 142,   0, 118, 154,  53, 175,  38,   8, 240,  89,  44, 227, 160,  50,  31, 107, 249, 125,  43},
+    {235,  60, 116,  77, 138, 241,  21, 211, 174, 247, 155, 100,  41, 254, 136,  25, 180,  67, 134, 233,   7, 149,  77, 133, 166,  54, 148,  39, 241,  94, 161,  75,  14, 204, 112, 191, 239, 171,  49, 216,  31,  80, 236, 155,  88, 238, 192,  73, 222,  20, 250, 146, 212, 121, 173, 149,   6,  71, 215, 139, 203,  55, 182, 218},
+    {142,  24, 179, 214,   8, 122,  66, 108, 139,  29,  64, 214,  19, 161, 218,  83, 241, 116,  42, 173,  99, 253, 190,  18, 243,  86, 222, 113, 201,  56, 136, 184, 251,  89,  33,  59, 131,  75, 145,  93, 201, 172, 108,   9, 182,  55, 105,  36, 129, 198, 104,  82, 188,  66,  28, 201,  98, 241, 176,  90,   9, 167,  78,  15},
+    {123, 206,  89,  49, 228, 190, 159, 237,  50,  91, 230, 124, 186, 108,  53, 154,   1, 196,  91, 219,  28, 125,  51, 108, 197,  31, 176,  10, 145,  29, 232, 103,  48, 170, 149, 225,  16, 186, 254,  11, 127,  61, 228,  44, 121, 210, 150, 243, 167,  60,  15, 133,  45, 246, 110, 219,  41, 129,  23, 118, 244, 148, 109, 194},
+    { 42, 254, 150, 170, 104,  39,  85,  10, 199, 151, 170,   4,  71, 204,  32, 129, 225,  60, 163, 140,  73, 178, 224, 153,  67, 135, 101, 245,  70, 192, 122,  19, 217, 125,  70, 201,  94, 116,  42, 156, 221,  23, 166, 137, 251,  24,  81,  11,  94, 213, 181, 234, 162,   3, 141,  72, 156, 191,  64, 210,  51,  30, 233,  66},
+    {100,   3,  61, 128,  25, 248, 174, 130, 224, 112,  38, 249, 137,  89, 239, 174, 102,  36, 248,  12, 207,  41,  90,  22, 233, 205,  50, 164, 214,  91, 157,  62, 196,   4, 246,  29, 176, 229,  68, 191, 105,  79, 195,  92,  63, 200, 170, 220, 142,  35, 109,  74, 203,  95, 229, 182,  14, 253, 101, 143, 172,  84, 215, 177},
+    {133, 224, 183, 205,  74, 146, 213,  63,  20,  78, 194,  58, 216, 163,  11,  65, 212, 123,  82, 192, 106, 243, 168, 116, 182,   1,  81, 129,  15,  42, 250, 177,  86, 141, 105, 152,  50, 132,   0, 245, 140,  35, 234,   5, 151, 111,  48, 123,  69, 255, 152,  25, 126,  58,  33, 119,  85,  45, 225,   0, 197, 125,  16, 157},
+    { 80,  31, 111, 238,   9, 118,  47, 100, 187, 236, 147, 101,  28, 118, 192, 147,  24, 182, 158,  52, 128,  18,  69, 142,  46, 255, 111, 187, 227, 140, 109,  27, 232,  46, 222,  76, 213, 165,  85, 175,  56, 212, 123, 173, 241,  29, 183, 233,   2, 194,  54, 223, 175, 248, 197, 144, 213, 167, 116,  72, 240,  98,  40, 245},
+    {201, 150,  53,  90, 160, 194, 228, 165,  34, 126,   8, 179, 230,  48,  79, 251,  94, 221,   5, 234, 149, 214, 194, 231,  89, 158, 212,  23,  60, 174,  74, 208, 120, 162,  12, 185, 117,  22, 237,  99,  15, 154,  73,  39,  98, 214,  86, 139,  99, 167, 116,  88,  10, 156, 102,  17,  59, 189,  29, 160,  52, 141, 191,  62},
+    {222,  11, 177, 212,  40,  80,  16, 136, 253,  88, 207,  70, 156, 132, 202,  37, 140,  55, 116,  77,  37,  98,  56,  11, 132,  32,  72, 144,  98, 236,   7, 155,  57, 193,  98, 252,  40,  66, 127, 206, 185, 109, 223, 192, 144,  64,  20, 205,  41, 244,  22, 187, 135,  47,  77, 220, 243,  94, 132, 223, 200,  13, 172, 115},
+    {135,  99, 251, 120, 142, 242, 111,  68, 176,  47, 117,  21, 245,  91,   4, 112, 236, 167, 205, 185, 252, 160, 182, 115, 221, 171, 197, 243,  47, 190, 128,  92, 244,  21,  72, 137, 168, 216, 148,  47,  30, 253,  58,  12, 120, 248, 173, 153,  78, 124, 213,  67, 239, 205, 165, 123,  36, 153,   8,  79, 111, 252,  89,  24},
+    { 59, 164,  34,  69,   5, 182, 207,  28, 217, 153, 226, 191,  56, 170, 220, 186,  71,  14,  96,  30, 124,  17,  83, 240,  39,  95,   5, 114, 163,  20, 216,  40, 173, 212, 112, 198,   6,  93, 231,  79, 168, 134,  92, 158, 217,  49, 112,  14, 222,  55, 157,  98,  32, 112,   2, 182,  67, 206, 236, 176,  31,  67, 156, 230},
+    {186,  85, 202, 232, 166,  89,  54, 144,  94,   2,  79, 137, 105,  24, 145,  47, 130, 216, 153,  62, 226, 140, 203,  64, 147, 207,  60, 137, 224,  76, 109, 136,  63, 149,  35, 238,  58, 182,  20, 120, 195,   4, 235, 181,  27,  82, 188, 237, 134, 181,   7, 195, 143, 229,  89, 254, 140, 102,  45, 120, 219, 141, 204,  37},
+    {246,   9, 147, 108,  24, 126, 238, 196, 115, 246, 183,  32, 237, 206,  82, 254, 107,  35, 242, 174, 106,  44, 169,   9, 123, 174, 247,  88,  30, 178, 250, 199,   1, 226,  79, 125, 157, 104, 246,  62, 212, 107,  70,  43, 137, 207,  98,  66,  36, 108, 242,  45,  72, 175,  26,  54, 194,  20, 169,  59, 192,   8, 100, 125},
+    { 71, 117, 221,  57, 188, 224,  40,  13, 170,  45,  66, 162, 122,  59, 166,  19, 183, 141,  86,   2, 211,  73, 250, 101, 219,  21,  43, 193, 147,  54,  17,  87, 168, 103, 185,  22, 214,  45, 136, 165,  37, 154, 220, 122, 246, 162,   0, 149, 204,  80, 165, 219, 124, 211, 156, 128, 224,  82, 247, 134,  90, 239,  52, 159},
+    {174, 198,  42,  95, 141,  68, 159,  83, 130, 207, 100, 220,   7, 198, 102, 230,  69, 207,  53, 188, 126, 155,  32, 184,  81, 160, 116, 212,  98, 233, 156, 118, 240,  48, 141, 255,  68, 198,   8, 226,  95,  17, 190,  87,  20,  59, 225, 118, 253,  13, 137,  95,  17,  63, 103,  40, 177, 116,   3, 157,  30, 178, 211,  18},
+    {233,  28, 155, 243,   0, 206, 103, 255, 186,  17, 239, 145,  87, 154,  39, 127,   9, 161, 109, 236,  25,  94, 231, 135,  51, 228,  65,   3, 128,  72, 189,  32,  69, 201,  14,  93, 170, 114,  84, 185, 127, 251,  54, 168, 200, 103, 180,  30, 158,  61, 198,  38, 248, 187, 233,  14, 210,  67, 232, 198,  72, 114, 140,  87},
+    {130, 103,  69, 213, 120, 177,  25, 143,  56,  77, 119,  29,  51, 247, 172, 211,  92, 249,  40, 138, 215,  64, 200,  10, 106, 190, 146, 254, 169,  19, 226, 135, 217, 161, 126, 231,  30, 143, 240,  42,  68, 150, 112,  33, 241, 143,  81,  47, 190, 106, 227, 169, 120,  81, 138, 165,  95, 148,  48, 103, 222,  40, 254,  59},
+    {218, 192, 169,  17,  88,  60, 220,  40, 232, 159, 199, 178, 216, 113,  71,  27, 144, 179,  73,  17, 168, 118,  47, 175, 243,  27,  80,  41, 198,  90,  51, 107,   6,  84,  44, 183,  60, 209,  19, 166, 224,   5, 209,  74, 125,  12, 215, 234, 132,  72,  22, 148,  55,   1, 201,  45, 252,  27, 173, 132,  19, 162, 186,   4},
+    { 35, 144,  49, 250, 131, 160, 193, 107, 128,  11,  96,  64, 138,   0, 193, 226,  52, 119, 228, 195,  84, 252, 144,  89, 157, 120, 220, 136, 104, 240, 150, 174, 196, 249, 117, 219, 155, 105,  80, 133, 197,  88, 161, 229, 189,  63, 159,  92,   5, 244, 207,  92, 182, 242, 109,  71, 124, 191,  87, 242, 205,  81, 147,  96},
+    {240,  77, 114, 205,  33, 231,   7,  82, 175, 210, 244,  39, 229, 104, 152,  83, 185,  10, 102, 154,  42,   3, 218,  31,  66, 202,  13, 183,  62,  22, 208,  34,  63, 145,  25,  76,   0, 178, 250,  56, 111,  36, 136,  23, 102,  40, 205, 117, 177, 142,  44, 117, 224,  32, 146, 214,  19, 221,  61,   5, 118,  47, 231, 123},
+    {171, 197,  20, 154, 101,  74, 144, 248,  58,  23, 146,  78, 172,  24, 248,  41, 132, 241,  58, 212, 128, 187, 110, 179, 239,  98,  52, 154, 232, 129,  77, 121, 228,  96, 189, 239, 135,  45, 200,  11, 232, 186,  61, 255, 174, 146, 243,  26,  56,  86, 192,  13, 157,  60,  88, 180, 158, 104, 139, 165, 194,  71, 211,  12},
+    { 63,  95, 227,  57, 178, 213,  43, 189, 119, 164, 101, 195, 122,  60, 208,  95, 159, 204,  28,  91, 233,  75,  48, 135,  16, 168, 225, 112,   0, 193, 245, 159,  10, 171,  38, 110, 212,  91, 152, 124, 170,  94, 216, 119,   0,  84,  65, 187, 220, 161, 253,  75, 211, 122, 238,   7,  54, 249,  38, 227,  28, 102, 155,  41},
+    {249, 164, 132,   4, 239, 116,  19,  91, 225,  34, 241,   9, 223, 140, 177,   5,  70, 115, 173, 141,  18, 160, 247, 204,  81, 124,  34,  74, 172,  92,  37, 105,  56, 215,  71, 155,  16,  61, 238,  33,  74,  16, 150,  45, 201, 224, 137,  99,  10, 126,  35, 106, 174,  24, 195, 135,  96, 184,  75, 126, 178, 244, 133, 190},
+    {117,  26, 210,  84, 149,  67, 172, 135, 205,  75, 143,  52,  88,  37, 109, 234, 188,  38, 254,  64, 192, 103,  29,  62, 150, 234, 184, 214, 141,  58, 209, 179, 139, 250, 124, 196, 228, 172, 114, 209, 142, 244, 192,  71, 165, 110,  36, 235, 152, 203,  62, 231, 140,  50,  76, 226,  28, 152, 209,   8,  90,  53,  20,  81},
+    {225,  49, 105, 187,  38, 199, 254,  50,   5, 110, 168, 214, 184, 251, 153,  21, 134, 213, 101,   9, 227, 123, 218, 178,   4,  99,  50,  23, 255, 122,  16, 226,  30,  90,   4,  50,  99,  27,  82, 189,  51, 107,  23,  96, 247,  13, 183,  52,  77, 112, 180,   6,  95, 246, 156, 108, 203,  62, 239, 111, 162, 222, 202, 150},
+    {178,  74, 161, 241, 122,  16, 102, 160, 231, 189,  64, 126,  13, 100,  67, 221,  83,  52, 164, 145,  79,  37, 139,  86, 242, 200, 115, 160,  80, 196, 153,  72, 113, 200, 149, 179, 129, 253, 160,   5, 228, 127, 217, 154,  56, 119, 207, 164, 250,  27, 222, 150, 202,  19, 176,  42, 128,  16, 143,  44, 183,  65, 107,   1},
+    {138, 233,  11,  61, 145, 224,  70, 130,  87,  26, 242,  43, 160, 203,  35, 172, 114, 200,  27, 240, 175, 202,  54, 165,  21, 131,  67, 233,   8,  97,  44, 245, 170,  57, 239,  75, 205,  42, 140,  70, 175,  85,  40, 184, 227,  81, 141,  18,  95, 131,  46,  81, 123,  66, 218,  90, 252, 190,  86, 233,  26, 129, 251,  41},
+    {208, 112, 193,  93,  31, 209, 176,  38, 203, 148, 105, 218,  81, 122, 244, 142,   4, 228, 128,  68, 109,   6, 249,  97, 191,  39, 209, 175, 139, 223, 189, 130,   9, 217,  31, 111,  14, 218,  96, 235,  20, 148, 207,   3, 131,  34, 235,  64, 215, 194, 173, 244,  31, 189, 138,   3, 161,  68, 119, 210, 153,  79, 189,  94},
+    { 55,  26, 134, 250, 165,  99,   9, 246,  62, 172,   1, 135, 180,  18,  56, 184,  74,  97, 189,  46, 221, 158, 121,  65, 224, 151,  83,  28,  58, 111,  32,  85, 159,  96, 141, 188, 166,  59, 117, 196,  47, 242, 113,  73, 169, 104, 187, 155, 115,   1,  60, 158,  97, 236, 109,  57, 227,  35, 175,   7,  57, 227,  20, 164},
+    { 76, 224, 181,  49,  74, 195, 118, 142,  91, 226,  48, 252,  68, 210, 104, 236,  30, 160, 252,  16,  91, 208,  31, 138,  12, 105, 251, 122, 237, 172, 214,  64, 230, 195,  48,  80, 225, 149,  26, 170, 134,  93, 181,  54, 255, 206,  14,  46, 245,  89, 139, 207,  16,  48, 174, 206, 144,  93, 242, 108, 203, 141, 114, 243},
+    {151, 123,  90,   4, 152, 227,  45, 210,  19, 121, 194,  97, 164,  34, 149, 199, 121,  54, 132, 181, 148,  75, 172, 235, 186,  50, 163, 193,   0,  90, 151,  14, 123,  26, 239, 127,   0, 244,  84, 214,  65,  10, 220, 139,  22,  92, 147,  76, 171, 222,  38, 113, 229, 148,  82,  14, 121, 195,  23, 166,  88,  38, 180,   8},
+    {193,  37, 209, 237, 110,  26, 163,  70, 180, 154,  75,  11, 126, 227,  85,  15, 170,  80, 204, 107,  25, 243,  48, 111,  80, 218,  22,  73, 142,  47, 202, 250, 181, 103, 161,  66, 201, 105,  41, 124, 250, 194,  37, 163, 118,  51, 237, 211, 123,  24, 190,  70, 181, 125, 248,  39, 223,  73,  49, 133, 254,  68, 215, 100},
+    {240,  63, 140, 176,  55, 134, 251, 100, 234,  32, 213, 239, 182,  59, 139, 215,  45, 241,   2, 227,  64, 127, 201,   4, 158, 133, 101, 210, 232, 109, 131,  32,  82,  46, 217,  19, 171, 137, 191,  16, 156, 108,  83, 231, 200, 183,  99,   7,  61, 148, 252,  95,   6,  57, 188, 102, 169, 149, 230, 182,  12, 126, 157,  25},
+    {119, 169,  15,  96, 203,  79, 187,   3,  57, 113, 139,  44, 104,  26, 249, 111, 185,  97, 146,  39, 191, 153,  91, 223,  41, 247,  59, 169,  28, 184,  67, 166, 209, 148, 117, 255,  87,  51, 236,  76, 178,  55, 133,   2,  71,  33, 131, 158, 198, 105,  44, 167, 220, 155,  29, 208,  59,   2, 110,  84, 209,  53, 231,  88},
+    {216,  78, 245,  44, 225,  20, 121, 217, 151, 201,  85, 172, 207,  75, 157,   9,  69, 164, 213, 115,  79, 254,  29, 179, 117, 190,  15, 148,  85, 240,  12, 100, 237,   4,  70, 179,  28, 155, 212, 101,  32, 239, 206, 150, 249, 168, 218,  80, 240,  21, 207, 131,  77, 111, 238,  85, 128, 249, 192,  36, 161, 103, 188,  43},
+    {  0, 198, 131, 105, 165, 144,  40, 170,  71,  24, 255,   7, 121, 224, 192, 131, 234,  22,  57, 135,  10, 166,  53, 142,  69,  95, 204, 120,  50, 216, 137, 189,  53, 128, 197,  96, 225, 121,   5, 143, 186, 120,  19,  95,  46, 115,  12,  50, 171, 122,  65, 233,  33, 197,  13, 146, 178,  25,  74, 138, 241,  17, 130, 151},
+    { 61, 159,  29, 189,  65, 248,  86, 234, 107, 185, 129, 162,  59,  29,  95,  46,  86, 195, 245, 180, 221, 104, 199, 237,   8, 225,  39, 246, 173, 106,  34,  78, 159, 229,  39, 144,  55, 194,  72, 231,  48,  84, 171, 221, 193,  75, 235, 142,  94, 190,   0, 145, 178,  52, 119, 229,  42, 206, 114, 220,  60, 200,  79, 249},
+    {106, 230,  85, 220,  13, 114, 196,   8,  52, 223,  35,  81, 240, 145, 173, 228, 153, 121,  35,  90,  65,  27, 124,  82, 175, 133, 158,  71,   2, 146, 200, 248,  16, 108, 210,  10, 239, 108, 169,  21, 197, 253,  63, 138,  26, 128, 177, 205,  35, 248,  83, 214,  97, 254,  78, 162,  63,  93, 153,   7, 173,  98,  33, 178},
+    { 18, 126,  46, 140, 177,  57, 158, 132, 210, 148,  99, 179, 206, 110,  15, 201,  68,   7, 171, 146, 203, 241, 157,  39, 210,  21, 101, 194, 222,  90,  56, 121, 174,  81, 155,  66, 176,  32, 136,  89, 152, 115,   8, 163, 242, 101,  58,  16, 113, 156,  47, 125,  22, 170, 133,   4, 219, 181, 245,  49, 124, 234, 139, 211},
+    { 76, 194, 252,  98, 213,  35, 242,  93,  21,  64, 229,   4,  48,  73, 136,  38, 253, 100, 232,  45, 116,   0, 184,  62, 108, 229,  48, 129,  30, 180, 231,  24, 206,  48, 245, 127,  98, 201, 247,  52, 217,  36, 202,  82,  43, 212, 154, 229,  73, 210, 174, 235,  67, 205,  39, 195, 107,  21, 130,  77, 213,  15,  56, 164},
+    { 37, 156,   6,  66, 163, 125,  74, 181, 202, 113, 167, 127, 248, 186, 219,  88, 179, 126, 195,  78, 222,  93, 135, 252, 148, 171,  87, 247, 156, 113,  72, 152, 133,  94, 187,  19, 226,  77,   1, 121, 180, 103, 236, 124, 186,   3,  89, 182, 136,  27,  97,  11, 150, 102, 237,  81, 143, 228,  37, 165,  92, 183, 110, 241},
+    { 89, 219, 118, 185,  24, 225,   2, 150,  45, 236,  31,  78, 151,  23, 117, 162,  57,  28, 143,  14, 163,  55, 213,  24,  76,   6, 201,  60,  15, 214,  43, 255,   3, 222,  36, 164,  56, 140, 160, 234,  69,  15, 168,  62, 144, 247, 118,  46, 237,  63, 194, 131, 223,  29, 157,  50, 175,  65, 199, 252, 145,  32, 204, 130},
+    {192,  52, 146, 235,  94, 200, 111, 253,  83, 137, 192, 216,  98,  53, 235,   6, 206, 226,  69, 247, 188, 119,  37, 197, 128, 238, 115, 145, 186,  80, 166, 103, 176,  67, 120, 210, 107, 191,  41, 207,  96, 151,  49, 216,  28,  71, 198,  17, 152, 108, 251,  51,  86, 183, 120, 247,  12,  94, 113,   1,  59, 228,  70,   9},
+    {245, 108,  27,  77,  44, 142,  61, 166,  23, 104,  60,   9, 173, 199, 142, 104,  80, 152, 110,  33,  87, 237, 154,  99, 177,  46, 220,  29, 100, 232, 129,  32, 203, 143, 242,  78,  10, 250,  89,  19, 126, 198, 251, 111, 176,  95, 162, 219,  83, 179,   2, 161, 213,  70,  22, 204, 132, 223, 159, 190, 134, 105, 175, 152},
+    { 18, 181, 216, 164, 244, 190,  34, 215, 183, 227, 158, 247, 125,  72,  37, 249, 181,  44, 196, 136, 175,  15,  70, 228,  11,  90, 163,  65, 199,   6,  54, 238,  85,  14,  47, 183, 155, 133,  55, 218, 181,  35,  80,  11, 133, 238,  54, 126,  34, 208, 122,  39, 139, 233, 104,  57, 182,  30,  73,  47, 240,  25, 212,  82}
+};
+
+const uint8_t* blue_noise64x64_matrix(void)
+{
+    return &BLUE_NOISE_64X64[0][0];
+}
+
+// Most rows an error diffusion matrix may span, including the current one
+#define MAX_DIFFUSION_ROWS 4
+
+// Pixels a row processes between progress updates
+#define DIFFUSION_SPAN 64
+
+// Division rounding towards minus infinity, so results do not depend on the compiler
+static int floor_div(int numerator, int divisor)
+{
+    return (numerator >= 0) ? numerator / divisor : -((-numerator + divisor - 1) / divisor);
+}
+
+static int clamp_colour(int value)
+{
+    return (value > MAX_COLOUR_VALUE) ? MAX_COLOUR_VALUE : (value < 0) ? 0 : value;
+}
+
+/*
+ * Kernels write row y's indices to the front of the RGB buffer, over bytes that belonged to rows
+ * up to about y / 3. Once rows run in parallel, a row is finished into a private buffer and copied
+ * in only when every row whose pixels sit under its indices has been read (progress == width).
+ */
+static void wait_for_rows_under(volatile int* progress, int y, int width)
+{
+    const int covered = (y + 1 + 2) / RGB_COMPONENTS - 1;
+    for (int r = 0; r <= covered && r < y; r++) {
+        while (pool_load_acquire(&progress[r]) < width) {
+            pool_yield();
+        }
     }
+}
+
+// A decoded RGB image, described as a layout
+static PixelLayout image_pixel_layout(const ImageData* image)
+{
+    PixelLayout layout;
+    layout.top_row = image->data;
+    layout.row_stride = (ptrdiff_t)image->width * RGB_COMPONENTS;
+    layout.pixel_size = RGB_COMPONENTS;
+    layout.order = PIXEL_ORDER_RGB;
+    layout.width = image->width;
+    layout.height = image->height;
+    return layout;
+}
 
-    const int width = image->width;
-    const int height = image->height;
+static bool layout_is_packed_rgb(const PixelLayout* layout)
+{
+    return layout->order == PIXEL_ORDER_RGB && layout->pixel_size == RGB_COMPONENTS;
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * RGB_COMPONENTS;
-            uint8_t oldR = image->data[idx];
-            uint8_t oldG = image->data[idx + 1];
-            uint8_t oldB = image->data[idx + 2];
-
-            uint8_t newR = oldR;
-            uint8_t newG = oldG;
-            uint8_t newB = oldB;
-
-            quantize_pixel_with_map_reduced(&newR, &newG, &newB);
-
-            image->data[idx] = newR;
-            image->data[idx + 1] = newG;
-            image->data[idx + 2] = newB;
-
-            float errorR = (float)(oldR - newR);
-            float errorG = (float)(oldG - newG);
-            float errorB = (float)(oldB - newB);
-
-            for (int i = 0; i < matrix_size; i++) {
-                int nx = x + matrix[i].x_offset;
-                int ny = y + matrix[i].y_offset;
-
-                if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                    int adj_idx = (ny * width + nx) * RGB_COMPONENTS;
-                    image->data[adj_idx] = (uint8_t)fmin(MAX_COLOUR_VALUE, fmax(0, image->data[adj_idx] + errorR * matrix[i].weight));
-                    image->data[adj_idx + 1] = (uint8_t)fmin(MAX_COLOUR_VALUE, fmax(0, image->data[adj_idx + 1] + errorG * matrix[i].weight));
-                    image->data[adj_idx + 2] = (uint8_t)fmin(MAX_COLOUR_VALUE, fmax(0, image->data[adj_idx + 2] + errorB * matrix[i].weight));
-                }
+// Row y as packed RGB through lut (NULL for none): the layout's own row when that already is the answer
+static const uint8_t* layout_rgb_row(const PixelLayout* layout, int y, const ToneLut* lut, uint8_t* scratch)
+{
+    const uint8_t* row = layout->top_row + (ptrdiff_t)y * layout->row_stride;
+    if (!lut && layout_is_packed_rgb(layout)) {
+        return row;
+    }
+
+    const int r = (layout->order == PIXEL_ORDER_BGR) ? 2 : 0;
+    const int g = (layout->order == PIXEL_ORDER_GRAY) ? 0 : 1;
+    const int b = (layout->order == PIXEL_ORDER_RGB) ? 2 : 0;
+    uint8_t* out = scratch;
+    if (lut) {
+        for (int x = 0; x < layout->width; x++, row += layout->pixel_size, out += RGB_COMPONENTS) {
+            out[0] = lut->channel[0][row[r]];
+            out[1] = lut->channel[1][row[g]];
+            out[2] = lut->channel[2][row[b]];
+        }
+    }
+    else {
+        for (int x = 0; x < layout->width; x++, row += layout->pixel_size, out += RGB_COMPONENTS) {
+            out[0] = row[r];
+            out[1] = row[g];
+            out[2] = row[b];
+        }
+    }
+    return scratch;
+}
+
+/*
+ * Errors are not written back into the image: each pixel's error times the entry weight is added to
+ * signed error rows (padded left and right so no neighbour needs a bounds check) and divided by the
+ * matrix divisor once, when the pixel is read. Nothing is clipped until a pixel is quantized.
+ *
+ * Rows are dithered as a wavefront: each worker takes the next row and trails the row above by `lag`
+ * pixels, the furthest a row below reaches back (2 for Floyd-Steinberg and Atkinson, 3 for Jarvis).
+ * Error is kept in one plane per matrix row offset, so every error row has a single writer: plane d,
+ * slot y holds what row y - d passed down to row y. A pixel reads the sum of its planes, which is the
+ * same integer sum in any schedule, so the output does not depend on the thread count. Workers only
+ * share per-row progress counters; planes are rings of `slots` rows reused once their reader is done.
+ */
+typedef void (*DiffusionRowFunc)(const uint8_t* src, uint8_t* dst, int32_t* const* in, int32_t* const* out, int plane_count, int x_begin, int x_end);
+
+typedef struct {
+    const PixelLayout* layout;
+    const ToneLut* lut;    // Applied as rows are read, NULL for none
+    uint8_t* output;       // width indices per row
+    bool in_place;         // output overlays the layout's own rows (a decoded image)
+    DiffusionRowFunc row_func;
+    int plane_count;       // Largest y_offset + 1
+    int pad;               // Largest |x_offset|
+    int lag;
+    int slots;
+    size_t row_stride;
+    int32_t* planes;
+    uint8_t* row_buffers;  // One output row per worker
+    uint8_t* rgb_buffers;  // One RGB row per worker, unless rows are read straight from the layout
+    volatile int* progress; // Pixels finished, per image row
+    volatile int next_row;
+} DiffusionJob;
+
+static int32_t* diffusion_plane_row(DiffusionJob* job, int plane, int y)
+{
+    return job->planes + ((size_t)plane * job->slots + (size_t)(y % job->slots)) * job->row_stride + job->pad * RGB_COMPONENTS;
+}
+
+// The error rows row y reads, and the cleared rows it passes its own error down into
+static void diffusion_row_planes(DiffusionJob* job, int y, int32_t** in, int32_t** out)
+{
+    for (int d = 0; d < job->plane_count; d++) {
+        in[d] = diffusion_plane_row(job, d, y);
+        out[d] = diffusion_plane_row(job, d, y + d);
+        memset(out[d] - job->pad * RGB_COMPONENTS, 0, job->row_stride * sizeof(int32_t));
+    }
+}
+
+static void wait_for_progress(DiffusionJob* job, int y, int needed)
+{
+    while (pool_load_acquire(&job->progress[y]) < needed) {
+        pool_yield();
+    }
+}
+
+static void diffusion_worker(void* context, int worker_index)
+{
+    DiffusionJob* job = (DiffusionJob*)context;
+    const int width = job->layout->width;
+    const int height = job->layout->height;
+    uint8_t* row_buffer = job->row_buffers + (size_t)worker_index * width;
+    uint8_t* rgb_buffer = job->rgb_buffers ? job->rgb_buffers + (size_t)worker_index * width * RGB_COMPONENTS : NULL;
+
+    for (;;) {
+        const int y = pool_atomic_fetch_add(&job->next_row, 1);
+        if (y >= height) break;
+
+        // The slots this row writes last held error for previous_reader, which must have used it up
+        const int previous_reader = y + job->plane_count - 1 - job->slots;
+        if (previous_reader >= 0) {
+            wait_for_progress(job, previous_reader, width);
+        }
+
+        int32_t* in[MAX_DIFFUSION_ROWS];
+        int32_t* out[MAX_DIFFUSION_ROWS];
+        diffusion_row_planes(job, y, in, out);
+
+        const uint8_t* src = layout_rgb_row(job->layout, y, job->lut, rgb_buffer);
+        uint8_t* dst = job->in_place ? row_buffer : job->output + (size_t)y * width;
+        for (int x_begin = 0; x_begin < width; x_begin += DIFFUSION_SPAN) {
+            const int x_end = (x_begin + DIFFUSION_SPAN < width) ? x_begin + DIFFUSION_SPAN : width;
+            if (y > 0) {
+                const int needed = x_end - 1 + job->lag;
+                wait_for_progress(job, y - 1, needed < width ? needed : width);
             }
+            job->row_func(src, dst, in, out, job->plane_count, x_begin, x_end);
+            pool_store_release(&job->progress[y], x_end);
+        }
+
+        if (job->in_place) {
+            wait_for_rows_under(job->progress, y, width);
+            memcpy(job->output + (size_t)y * width, row_buffer, width);
+        }
+    }
+}
+
+// Padding, rows spanned and the wavefront lag a matrix needs
+static int diffusion_extent(const ErrorDiffusionEntry* matrix, int matrix_size, int* pad, int* row_count, int* lag)
+{
+    *pad = 0;
+    *row_count = 1;
+    *lag = 1;
+    for (int i = 0; i < matrix_size; i++) {
+        const int dx = matrix[i].x_offset;
+        const int dy = matrix[i].y_offset;
+        if (dy < 0 || dy >= MAX_DIFFUSION_ROWS || (dy == 0 && dx <= 0)) {
+            return fileio_error("Error diffusion matrix must only reach pixels not yet processed.");
+        }
+        *pad = (abs(dx) > *pad) ? abs(dx) : *pad;
+        *row_count = (dy + 1 > *row_count) ? dy + 1 : *row_count;
+        if (dy > 0 && 1 - dx > *lag) {
+            *lag = 1 - dx;
         }
     }
     return EXIT_SUCCESS;
 }
 
-int floydSteinbergDither(ImageData* image)
+static int run_diffusion_job(const PixelLayout* layout, const ToneLut* lut, uint8_t* output, bool in_place, ThreadPool* pool,
+                             const ErrorDiffusionEntry* matrix, int matrix_size, DiffusionRowFunc row_func)
 {
-    const ErrorDiffusionEntry matrix[] = {
-        { 1, 0, 7.0f / 16.0f },
-        {-1, 1, 3.0f / 16.0f },
-        { 0, 1, 5.0f / 16.0f },
-        { 1, 1, 1.0f / 16.0f }
-    };
-    return genericDither(image, matrix, sizeof(matrix) / sizeof(matrix[0]));
+    DiffusionJob job = { 0 };
+    job.layout = layout;
+    job.lut = lut;
+    job.output = output;
+    job.in_place = in_place;
+    job.row_func = row_func;
+    if (diffusion_extent(matrix, matrix_size, &job.pad, &job.plane_count, &job.lag) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    const int workers = thread_pool_size(pool);
+    const int width = layout->width;
+    const bool needs_rgb_rows = lut || !layout_is_packed_rgb(layout);
+    job.slots = workers + job.plane_count;
+    job.row_stride = (size_t)(width + 2 * job.pad) * RGB_COMPONENTS;
+
+    // Zeroed, since the first rows read planes no row above them writes
+    job.planes = (int32_t*)calloc((size_t)job.plane_count * job.slots * job.row_stride, sizeof(int32_t));
+    job.row_buffers = (uint8_t*)malloc((size_t)workers * width + 1);
+    job.rgb_buffers = needs_rgb_rows ? (uint8_t*)malloc((size_t)workers * width * RGB_COMPONENTS + 1) : NULL;
+    job.progress = (volatile int*)calloc(layout->height + 1, sizeof(int));
+    if (!job.planes || !job.row_buffers || !job.progress || (needs_rgb_rows && !job.rgb_buffers)) {
+        free(job.planes);
+        free(job.row_buffers);
+        free(job.rgb_buffers);
+        free((void*)job.progress);
+        return fileio_error("Failed to allocate error diffusion rows.");
+    }
+
+    thread_pool_run(pool, diffusion_worker, &job);
+
+    free(job.planes);
+    free(job.row_buffers);
+    free(job.rgb_buffers);
+    free((void*)job.progress);
+    return EXIT_SUCCESS;
 }
 
-int jarvisDither(ImageData* image)
+static int run_diffusion(ImageData* image, ThreadPool* pool, const ErrorDiffusionEntry* matrix, int matrix_size, DiffusionRowFunc row_func, const char* name)
 {
-    const ErrorDiffusionEntry matrix[] = {
-    { 1, 0, 7.0f / 48.0f }, { 2, 0, 5.0f / 48.0f },
-    {-2, 1, 3.0f / 48.0f }, {-1, 1, 5.0f / 48.0f }, { 0, 1, 7.0f / 48.0f }, { 1, 1, 5.0f / 48.0f }, { 2, 1, 3.0f / 48.0f },
-    {-2, 2, 1.0f / 48.0f }, {-1, 2, 3.0f / 48.0f }, { 0, 2, 5.0f / 48.0f }, { 1, 2, 3.0f / 48.0f }, { 2, 2, 1.0f / 48.0f }
-    };
-    return genericDither(image, matrix, sizeof(matrix) / sizeof(matrix[0]));
+    if (!image || !image->data) {
+        fprintf(stderr, "Error: Null pointer passed to %s.\n", name);
+        return EXIT_FAILURE;
+    }
+    if (image->format != PIXEL_FORMAT_RGB888) {
+        fprintf(stderr, "Error: %s needs an RGB image.\n", name);
+        return EXIT_FAILURE;
+    }
+
+    const PixelLayout layout = image_pixel_layout(image);
+    if (run_diffusion_job(&layout, NULL, image->data, true, pool, matrix, matrix_size, row_func) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    compact_indexed_image(image);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * The palette is a grid and the quantizer picks each channel's level on its own, so the error a
+ * channel diffuses only ever depends on that channel. Channel mode dithers R, G and B as three
+ * independent serial passes on up to three threads, each one a plain raster scan over its own
+ * byte of every pixel, replacing it with the channel's index bits. A final pass ORs the bits into
+ * indices. The result is the same as the row wavefront, and it needs no synchronisation at all.
+ */
+// pixels points at the channel's byte of the row's first pixel
+typedef void (*ChannelRowFunc)(uint8_t* pixels, int32_t* const* rows, int channel, int width);
+
+typedef struct {
+    ImageData* image;
+    ChannelRowFunc row_func;
+    int pad;
+    int row_count;
+    volatile int next_channel;
+    volatile int failed;
+} ChannelDiffusionJob;
+
+static void channel_diffusion_worker(void* context, int worker_index)
+{
+    ChannelDiffusionJob* job = (ChannelDiffusionJob*)context;
+    const int width = job->image->width;
+    const size_t row_stride = (size_t)width + 2 * job->pad;
+    (void)worker_index;
+
+    for (;;) {
+        const int channel = pool_atomic_fetch_add(&job->next_channel, 1);
+        if (channel >= RGB_COMPONENTS) break;
+
+        int32_t* buffer = (int32_t*)calloc(job->row_count * row_stride, sizeof(int32_t));
+        if (!buffer) {
+            pool_store_release(&job->failed, 1);
+            break;
+        }
+        int32_t* rows[MAX_DIFFUSION_ROWS];
+        for (int r = 0; r < job->row_count; r++) {
+            rows[r] = buffer + r * row_stride + job->pad;
+        }
+
+        for (int y = 0; y < job->image->height; y++) {
+            job->row_func(job->image->data + (size_t)y * width * RGB_COMPONENTS + channel, rows, channel, width);
+
+            // The finished row becomes the furthest one down
+            int32_t* finished = rows[0];
+            for (int r = 1; r < job->row_count; r++) {
+                rows[r - 1] = rows[r];
+            }
+            rows[job->row_count - 1] = finished;
+            memset(finished - job->pad, 0, row_stride * sizeof(int32_t));
+        }
+        free(buffer);
+    }
 }
 
-int atkinsonDither(ImageData* image)
+static void pack_channel_bits_row(const uint8_t* src, uint8_t* dst, int y, int width, const void* context)
 {
-    const ErrorDiffusionEntry matrix[] = {
-    { 1, 0, 1.0f / 8.0f }, { 2, 0, 1.0f / 8.0f },
-    {-1, 1, 1.0f / 8.0f }, { 0, 1, 1.0f / 8.0f }, { 1, 1, 1.0f / 8.0f },
-    { 0, 2, 1.0f / 8.0f }
-    };
-    return genericDither(image, matrix, sizeof(matrix) / sizeof(matrix[0]));
+    (void)y;
+    (void)context;
+    for (int x = 0; x < width; x++, src += RGB_COMPONENTS) {
+        dst[x] = src[0] | src[1] | src[2];
+    }
 }
 
-int bayer16x16Dither(ImageData* image)
+static int run_channel_diffusion(ImageData* image, ThreadPool* pool, const ErrorDiffusionEntry* matrix, int matrix_size, ChannelRowFunc row_func, const char* name)
 {
     if (!image || !image->data) {
-        fileio_error("Null pointer passed to bayer16x16Dither.");
+        fprintf(stderr, "Error: Null pointer passed to %s.\n", name);
+        return EXIT_FAILURE;
+    }
+    if (image->format != PIXEL_FORMAT_RGB888) {
+        fprintf(stderr, "Error: %s needs an RGB image.\n", name);
         return EXIT_FAILURE;
     }
 
-    const int width = image->width;
-    const int height = image->height;
+    ChannelDiffusionJob job = { 0 };
+    int lag;
+    job.image = image;
+    job.row_func = row_func;
+    if (diffusion_extent(matrix, matrix_size, &job.pad, &job.row_count, &lag) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * RGB_COMPONENTS;
+    thread_pool_run(pool, channel_diffusion_worker, &job);
+    if (job.failed) {
+        return fileio_error("Failed to allocate error diffusion rows.");
+    }
+    return run_index_rows(image, pool, pack_channel_bits_row, NULL, name);
+}
 
-            int bayer_threshold = BAYER_MATRIX_16X16[y % BAYER_SIZE][x % BAYER_SIZE];
-            float normalized_bayer = (float)(bayer_threshold - 128);
+// Adds the pending error to a pixel, quantizes it and returns the index and the new error
+static uint8_t quantize_diffused_pixel(const uint8_t* src, const int32_t* pending, int divisor, int* errorR, int* errorG, int* errorB)
+{
+    int r = clamp_colour(src[0] + floor_div(pending[0], divisor));
+    int g = clamp_colour(src[1] + floor_div(pending[1], divisor));
+    int b = clamp_colour(src[2] + floor_div(pending[2], divisor));
 
-            int r = image->data[idx];
-            int g = image->data[idx + 1];
-            int b = image->data[idx + 2];
+    uint8_t newR, newG, newB;
+    uint8_t index = nearest_palette_index_separable((uint8_t)r, (uint8_t)g, (uint8_t)b);
+    palette_index_to_rgb(index, &newR, &newG, &newB);
 
-            r = (int)round((float)r + (normalized_bayer / 8.0f));
-            g = (int)round((float)g + (normalized_bayer / 8.0f));
-            b = (int)round((float)b + (normalized_bayer / 8.0f));
+    *errorR = r - newR;
+    *errorG = g - newG;
+    *errorB = b - newB;
+    return index;
+}
 
-            r = (r > MAX_COLOUR_VALUE) ? MAX_COLOUR_VALUE : (r < 0) ? 0 : r;
-            g = (g > MAX_COLOUR_VALUE) ? MAX_COLOUR_VALUE : (g < 0) ? 0 : g;
-            b = (b > MAX_COLOUR_VALUE) ? MAX_COLOUR_VALUE : (b < 0) ? 0 : b;
+/*
+ * A diffusion matrix is declared as a list of TAP(x_offset, y_offset, weight) over a divisor.
+ * DEFINE_DIFFUSION_KERNEL expands the list once into an ErrorDiffusionEntry table (used to size
+ * the error planes) and once into the body of the row loop, so every neighbour update has
+ * constant offsets and weights, the loop is fully unrolled and the divisor is a constant.
+ * The padded error rows take the place of separate edge loops.
+ */
+#define DIFFUSION_ENTRY(dx, dy, weight) { (dx), (dy), (weight) },
 
-            quantize_pixel_with_map_reduced((uint8_t*)&r, (uint8_t*)&g, (uint8_t*)&b);
+#define DIFFUSE_TAP(dx, dy, weight) {                                      \
+        int32_t* target = out[(dy)] + (x + (dx)) * RGB_COMPONENTS;         \
+        target[0] += errorR * (weight);                                    \
+        target[1] += errorG * (weight);                                    \
+        target[2] += errorB * (weight);                                    \
+    }
+
+#define DIFFUSE_CHANNEL_TAP(dx, dy, weight) rows[(dy)][x + (dx)] += error * (weight);
+
+#define DEFINE_DIFFUSION_KERNEL(name, TAPS, divisor)                                                        \
+static const ErrorDiffusionEntry name##Matrix[] = { TAPS(DIFFUSION_ENTRY) };                                 \
+                                                                                                             \
+static void name##Row(const uint8_t* src, uint8_t* dst, int32_t* const* in, int32_t* const* out,            \
+                      int plane_count, int x_begin, int x_end)                                               \
+{                                                                                                            \
+    for (int x = x_begin; x < x_end; x++) {                                                                  \
+        const int idx = x * RGB_COMPONENTS;                                                                  \
+        int32_t pending[RGB_COMPONENTS] = { in[0][idx], in[0][idx + 1], in[0][idx + 2] };                    \
+        for (int d = 1; d < plane_count; d++) {                                                              \
+            pending[0] += in[d][idx];                                                                        \
+            pending[1] += in[d][idx + 1];                                                                    \
+            pending[2] += in[d][idx + 2];                                                                    \
+        }                                                                                                    \
+                                                                                                             \
+        int errorR, errorG, errorB;                                                                          \
+        dst[x] = quantize_diffused_pixel(src + idx, pending, (divisor), &errorR, &errorG, &errorB);          \
+        TAPS(DIFFUSE_TAP)                                                                                    \
+    }                                                                                                        \
+}                                                                                                            \
+                                                                                                             \
+int name##Dither(ImageData* image, ThreadPool* pool)                                                         \
+{                                                                                                            \
+    return run_diffusion(image, pool, name##Matrix, sizeof(name##Matrix) / sizeof(name##Matrix[0]),         \
+                         name##Row, #name "Dither");                                                         \
+}                                                                                                            \
+                                                                                                             \
+static void name##ChannelRow(uint8_t* pixels, int32_t* const* rows, int channel, int width)                 \
+{                                                                                                            \
+    for (int x = 0; x < width; x++) {                                                                        \
+        uint8_t* pixel = pixels + x * RGB_COMPONENTS;                                                        \
+        const int value = clamp_colour(*pixel + floor_div(rows[0][x], (divisor)));                           \
+        const uint8_t level = palette_channel_level(channel, (uint8_t)value);                                \
+        const int error = value - palette_level_value(channel, level);                                       \
+        *pixel = (uint8_t)(level << channelIndexShift[channel]);                                             \
+        TAPS(DIFFUSE_CHANNEL_TAP)                                                                            \
+    }                                                                                                        \
+}                                                                                                            \
+                                                                                                             \
+int name##ChannelDither(ImageData* image, ThreadPool* pool)                                                  \
+{                                                                                                            \
+    return run_channel_diffusion(image, pool, name##Matrix, sizeof(name##Matrix) / sizeof(name##Matrix[0]), \
+                                 name##ChannelRow, #name "ChannelDither");                                   \
+}
 
-            image->data[idx] = r;
-            image->data[idx + 1] = g;
-            image->data[idx + 2] = b;
+#define FLOYD_STEINBERG_TAPS(TAP)               \
+    TAP( 1, 0, 7)                               \
+    TAP(-1, 1, 3) TAP( 0, 1, 5) TAP( 1, 1, 1)
+
+#define JARVIS_TAPS(TAP)                                                    \
+    TAP( 1, 0, 7) TAP( 2, 0, 5)                                             \
+    TAP(-2, 1, 3) TAP(-1, 1, 5) TAP( 0, 1, 7) TAP( 1, 1, 5) TAP( 2, 1, 3)   \
+    TAP(-2, 2, 1) TAP(-1, 2, 3) TAP( 0, 2, 5) TAP( 1, 2, 3) TAP( 2, 2, 1)
+
+#define ATKINSON_TAPS(TAP)                      \
+    TAP( 1, 0, 1) TAP( 2, 0, 1)                 \
+    TAP(-1, 1, 1) TAP( 0, 1, 1) TAP( 1, 1, 1)   \
+    TAP( 0, 2, 1)
+
+DEFINE_DIFFUSION_KERNEL(floydSteinberg, FLOYD_STEINBERG_TAPS, 16)
+DEFINE_DIFFUSION_KERNEL(jarvis, JARVIS_TAPS, 48)
+DEFINE_DIFFUSION_KERNEL(atkinson, ATKINSON_TAPS, 8)
+
+// Rows a worker claims at a time; one Bayer period, so a band reuses the same threshold rows
+#define INDEX_ROW_BAND BAYER_SIZE
+
+typedef struct {
+    const PixelLayout* layout;
+    uint8_t* output;        // width indices per row
+    bool in_place;          // output overlays the layout's own rows (a decoded image)
+    IndexRowFunc row_func;
+    const void* context;
+    uint8_t* row_buffers;   // One output row per worker, in place only
+    uint8_t* rgb_buffers;   // One RGB row per worker, for layouts that are not packed RGB
+    volatile int* progress; // Width once a row has been read, per image row
+    volatile int next_band;
+} IndexRowJob;
+
+static void index_row_worker(void* context, int worker_index)
+{
+    IndexRowJob* job = (IndexRowJob*)context;
+    const int width = job->layout->width;
+    const int height = job->layout->height;
+    uint8_t* row_buffer = job->row_buffers ? job->row_buffers + (size_t)worker_index * width : NULL;
+    uint8_t* rgb_buffer = job->rgb_buffers ? job->rgb_buffers + (size_t)worker_index * width * RGB_COMPONENTS : NULL;
+
+    for (;;) {
+        const int y_begin = pool_atomic_fetch_add(&job->next_band, 1) * INDEX_ROW_BAND;
+        if (y_begin >= height) break;
+        const int y_end = (y_begin + INDEX_ROW_BAND < height) ? y_begin + INDEX_ROW_BAND : height;
+
+        for (int y = y_begin; y < y_end; y++) {
+            const uint8_t* src = layout_rgb_row(job->layout, y, NULL, rgb_buffer);
+            if (!job->in_place) {
+                job->row_func(src, job->output + (size_t)y * width, y, width, job->context);
+                continue;
+            }
+            job->row_func(src, row_buffer, y, width, job->context);
+            pool_store_release(&job->progress[y], width);
+
+            wait_for_rows_under(job->progress, y, width);
+            memcpy(job->output + (size_t)y * width, row_buffer, width);
         }
     }
+}
+
+static int run_index_job(const PixelLayout* layout, uint8_t* output, bool in_place, ThreadPool* pool, IndexRowFunc row_func, const void* context)
+{
+    const int workers = thread_pool_size(pool);
+    IndexRowJob job = { 0 };
+    job.layout = layout;
+    job.output = output;
+    job.in_place = in_place;
+    job.row_func = row_func;
+    job.context = context;
+    if (in_place) {
+        job.row_buffers = (uint8_t*)malloc((size_t)workers * layout->width + 1);
+        job.progress = (volatile int*)calloc(layout->height + 1, sizeof(int));
+    }
+    if (!layout_is_packed_rgb(layout)) {
+        job.rgb_buffers = (uint8_t*)malloc((size_t)workers * layout->width * RGB_COMPONENTS + 1);
+    }
+    if ((in_place && (!job.row_buffers || !job.progress)) || (!layout_is_packed_rgb(layout) && !job.rgb_buffers)) {
+        free(job.row_buffers);
+        free(job.rgb_buffers);
+        free((void*)job.progress);
+        return fileio_error("Failed to allocate row buffers.");
+    }
+
+    thread_pool_run(pool, index_row_worker, &job);
+
+    free(job.row_buffers);
+    free(job.rgb_buffers);
+    free((void*)job.progress);
     return EXIT_SUCCESS;
 }
 
-int noDither(ImageData* image)
+int run_index_rows(ImageData* image, ThreadPool* pool, IndexRowFunc row_func, const void* context, const char* name)
 {
-    if (!image || !image->data) {
-        fileio_error("Null pointer passed to noDither.");
+    if (!image || !image->data || !row_func) {
+        fprintf(stderr, "Error: Null pointer passed to %s.\n", name);
+        return EXIT_FAILURE;
+    }
+    if (image->format != PIXEL_FORMAT_RGB888) {
+        fprintf(stderr, "Error: %s needs an RGB image.\n", name);
         return EXIT_FAILURE;
     }
 
-    const int width = image->width;
-    const int height = image->height;
+    const PixelLayout layout = image_pixel_layout(image);
+    if (run_index_job(&layout, image->data, true, pool, row_func, context) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    compact_indexed_image(image);
+    return EXIT_SUCCESS;
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * RGB_COMPONENTS;
+static OrderedDither* create_ordered_dither(int dither_method, const ToneLut* lut)
+{
+    switch (dither_method) {
+    case DITHER_BAYER_16X16: return ordered_dither_create(bayer16x16_matrix(), BAYER_SIZE, ORDERED_SPREAD_FIXED, lut);
+    case DITHER_BLUE_NOISE:  return ordered_dither_create(blue_noise64x64_matrix(), BLUE_NOISE_SIZE, ORDERED_SPREAD_LEVEL_STEP, lut);
+    default:
+        fileio_error("Not an ordered dither method.");
+        return NULL;
+    }
+}
+
+int ordered_dither_method(ImageData* image, ThreadPool* pool, int dither_method, const ToneLut* lut)
+{
+    OrderedDither* dither = create_ordered_dither(dither_method, lut);
+    if (!dither) {
+        return EXIT_FAILURE;
+    }
+    int result = ordered_dither_image(image, pool, dither, dither_method == DITHER_BAYER_16X16 ? "bayer16x16Dither" : "blueNoiseDither");
+    ordered_dither_free(dither);
+    return result;
+}
+
+int bayer16x16Dither(ImageData* image, ThreadPool* pool)
+{
+    return ordered_dither_method(image, pool, DITHER_BAYER_16X16, NULL);
+}
+
+int blueNoiseDither(ImageData* image, ThreadPool* pool)
+{
+    return ordered_dither_method(image, pool, DITHER_BLUE_NOISE, NULL);
+}
+
+/*
+ * Without dithering each channel maps to its share of the index on its own, so the tone LUT and
+ * the nearest level fold into three tables of pre-shifted bits: index = red[r] | green[g] | blue[b].
+ */
+typedef struct {
+    uint8_t channel[RGB_COMPONENTS][LUT_SIZE];
+} IndexTables;
+
+static void build_index_tables(IndexTables* tables, const ToneLut* lut)
+{
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        build_index_contribution_table(c, lut ? lut->channel[c] : NULL, tables->channel[c]);
+    }
+}
+
+static void index_table_row(const uint8_t* src, uint8_t* dst, int y, int width, const void* context)
+{
+    const IndexTables* tables = (const IndexTables*)context;
+    const uint8_t* red = tables->channel[0];
+    const uint8_t* green = tables->channel[1];
+    const uint8_t* blue = tables->channel[2];
+    (void)y;
+
+    for (int x = 0; x < width; x++, src += RGB_COMPONENTS) {
+        dst[x] = red[src[0]] | green[src[1]] | blue[src[2]];
+    }
+}
+
+int index_table_convert(ImageData* image, ThreadPool* pool, const ToneLut* lut, const char* name)
+{
+    IndexTables tables;
+    build_index_tables(&tables, lut);
+    return run_index_rows(image, pool, index_table_row, &tables, name);
+}
+
+int noDither(ImageData* image, ThreadPool* pool)
+{
+    return index_table_convert(image, pool, NULL, "noDither");
+}
+
+int dither_pixel_layout(const PixelLayout* layout, uint8_t* indices, ThreadPool* pool, int dither_method, const ToneLut* lut)
+{
+    if (!layout || !layout->top_row || !indices) {
+        return fileio_error("Null pointer passed to dither_pixel_layout.");
+    }
+
+    switch (dither_method) {
+    case DITHER_FLOYD_STEINBERG:
+        return run_diffusion_job(layout, lut, indices, false, pool, floydSteinbergMatrix,
+                                 sizeof(floydSteinbergMatrix) / sizeof(floydSteinbergMatrix[0]), floydSteinbergRow);
+    case DITHER_JARVIS:
+        return run_diffusion_job(layout, lut, indices, false, pool, jarvisMatrix,
+                                 sizeof(jarvisMatrix) / sizeof(jarvisMatrix[0]), jarvisRow);
+    case DITHER_ATKINSON:
+        return run_diffusion_job(layout, lut, indices, false, pool, atkinsonMatrix,
+                                 sizeof(atkinsonMatrix) / sizeof(atkinsonMatrix[0]), atkinsonRow);
+    case DITHER_BAYER_16X16:
+    case DITHER_BLUE_NOISE: {
+        OrderedDither* dither = create_ordered_dither(dither_method, lut);
+        if (!dither) {
+            return EXIT_FAILURE;
+        }
+        int result = run_index_job(layout, indices, false, pool, ordered_dither_row, dither);
+        ordered_dither_free(dither);
+        return result;
+    }
+    default: {
+        IndexTables tables;
+        build_index_tables(&tables, lut);
+        return run_index_job(layout, indices, false, pool, index_table_row, &tables);
+    }
+    }
+}
 
-            int r = image->data[idx];
-            int g = image->data[idx + 1];
-            int b = image->data[idx + 2];
+/*
+ * The streaming path runs the same kernels one row at a time: ordered and undithered rows need
+ * nothing from other rows, and error diffusion keeps a ring of plane_count error rows per plane,
+ * so memory does not grow with the image height. The output matches the whole-image functions.
+ */
+struct DitherStream {
+    int width;
+    int y;
+    IndexRowFunc index_row;     // Ordered dither or index tables, with the LUT folded in
+    const void* index_context;
+    OrderedDither* ordered;
+    IndexTables tables;
+    ToneLut lut;                // Applied to the row before error diffusion
+    DiffusionRowFunc diffusion_row;
+    DiffusionJob diffusion;     // Only the plane ring is used
+};
+
+DitherStream* dither_stream_create(int dither_method, int width, const ToneLut* lut)
+{
+    if (width <= 0) {
+        fileio_error("dither_stream_create needs a positive width.");
+        return NULL;
+    }
 
-            quantize_pixel_with_map_reduced((uint8_t*)&r, (uint8_t*)&g, (uint8_t*)&b);
+    DitherStream* stream = (DitherStream*)calloc(1, sizeof(DitherStream));
+    if (!stream) {
+        fileio_error("Failed to allocate dither stream.");
+        return NULL;
+    }
+    stream->width = width;
 
-            image->data[idx] = r;
-            image->data[idx + 1] = g;
-            image->data[idx + 2] = b;
+    const ErrorDiffusionEntry* matrix = NULL;
+    int matrix_size = 0;
+    switch (dither_method) {
+    case DITHER_FLOYD_STEINBERG:
+        matrix = floydSteinbergMatrix;
+        matrix_size = sizeof(floydSteinbergMatrix) / sizeof(floydSteinbergMatrix[0]);
+        stream->diffusion_row = floydSteinbergRow;
+        break;
+    case DITHER_JARVIS:
+        matrix = jarvisMatrix;
+        matrix_size = sizeof(jarvisMatrix) / sizeof(jarvisMatrix[0]);
+        stream->diffusion_row = jarvisRow;
+        break;
+    case DITHER_ATKINSON:
+        matrix = atkinsonMatrix;
+        matrix_size = sizeof(atkinsonMatrix) / sizeof(atkinsonMatrix[0]);
+        stream->diffusion_row = atkinsonRow;
+        break;
+    case DITHER_BAYER_16X16:
+    case DITHER_BLUE_NOISE:
+        stream->ordered = create_ordered_dither(dither_method, lut);
+        if (!stream->ordered) {
+            free(stream);
+            return NULL;
         }
+        stream->index_row = ordered_dither_row;
+        stream->index_context = stream->ordered;
+        return stream;
+    default:
+        build_index_tables(&stream->tables, lut);
+        stream->index_row = index_table_row;
+        stream->index_context = &stream->tables;
+        return stream;
     }
-    return EXIT_SUCCESS;
+
+    if (lut) {
+        stream->lut = *lut;
+    }
+    else {
+        tone_lut_identity(&stream->lut);
+    }
+
+    DiffusionJob* job = &stream->diffusion;
+    if (diffusion_extent(matrix, matrix_size, &job->pad, &job->plane_count, &job->lag) != EXIT_SUCCESS) {
+        free(stream);
+        return NULL;
+    }
+    // Serially, row y only ever writes slots y .. y + plane_count - 1, so plane_count slots suffice
+    job->slots = job->plane_count;
+    job->row_stride = (size_t)(width + 2 * job->pad) * RGB_COMPONENTS;
+    job->planes = (int32_t*)calloc((size_t)job->plane_count * job->slots * job->row_stride, sizeof(int32_t));
+    if (!job->planes) {
+        free(stream);
+        fileio_error("Failed to allocate error diffusion rows.");
+        return NULL;
+    }
+    return stream;
+}
+
+void dither_stream_free(DitherStream* stream)
+{
+    if (!stream) return;
+    ordered_dither_free(stream->ordered);
+    free(stream->diffusion.planes);
+    free(stream);
+}
+
+void dither_stream_row(DitherStream* stream, uint8_t* rgb, uint8_t* indices)
+{
+    const int y = stream->y++;
+
+    if (stream->index_row) {
+        stream->index_row(rgb, indices, y, stream->width, stream->index_context);
+        return;
+    }
+
+    uint8_t* pixel = rgb;
+    for (int x = 0; x < stream->width; x++, pixel += RGB_COMPONENTS) {
+        pixel[0] = stream->lut.channel[0][pixel[0]];
+        pixel[1] = stream->lut.channel[1][pixel[1]];
+        pixel[2] = stream->lut.channel[2][pixel[2]];
+    }
+
+    int32_t* in[MAX_DIFFUSION_ROWS];
+    int32_t* out[MAX_DIFFUSION_ROWS];
+    diffusion_row_planes(&stream->diffusion, y, in, out);
+    stream->diffusion_row(rgb, indices, in, out, stream->diffusion.plane_count, 0, stream->width);
+}
+
+typedef int (*DiffusionKernel)(ImageData* image, ThreadPool* pool);
+
+// Dithers a copy of rgb with kernel on threads workers; returns the malloc'd indices, or NULL
+static uint8_t* run_kernel_copy(DiffusionKernel kernel, const uint8_t* rgb, int width, int height, int threads)
+{
+    const size_t size = (size_t)width * height * RGB_COMPONENTS;
+    ImageData image = { 0 };
+    image.width = width;
+    image.height = height;
+    image.format = PIXEL_FORMAT_RGB888;
+    image.data = (uint8_t*)malloc(size);
+    if (!image.data) return NULL;
+    memcpy(image.data, rgb, size);
+
+    ThreadPool* pool = thread_pool_create(threads);
+    const int result = kernel(&image, pool);
+    thread_pool_destroy(pool);
+    if (result != EXIT_SUCCESS) {
+        free(image.data);
+        return NULL;
+    }
+    return image.data;
+}
+
+// Compares the row-parallel and plane-parallel diffusion kernels at several thread counts with
+// the row-parallel kernel on one thread, which runs the pixels in the serial order. Returns the
+// number of indices that differ, or -1 if a kernel could not run.
+long verify_parallel_dither(void)
+{
+    static const struct {
+        DiffusionKernel serial;
+        DiffusionKernel channel;
+    } kernels[] = {
+        { floydSteinbergDither, floydSteinbergChannelDither },
+        { jarvisDither,         jarvisChannelDither },
+        { atkinsonDither,       atkinsonChannelDither },
+    };
+    static const int thread_counts[] = { 1, 2, 3, 4, 7 };
+    const int width = 193;
+    const int height = 97;
+    const size_t pixel_count = (size_t)width * height;
+
+    // Gradients with a little noise on top, so both smooth areas and busy ones carry error
+    uint8_t* rgb = (uint8_t*)malloc(pixel_count * RGB_COMPONENTS);
+    if (!rgb) return -1;
+    uint32_t seed = 0x12345678u;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* pixel = rgb + ((size_t)y * width + x) * RGB_COMPONENTS;
+            seed = seed * 1664525u + 1013904223u;
+            pixel[0] = (uint8_t)((x * 255) / (width - 1) + (int)(seed >> 29) - 4);
+            pixel[1] = (uint8_t)((y * 255) / (height - 1) + (int)((seed >> 26) & 7) - 4);
+            pixel[2] = (uint8_t)(seed >> 24);
+        }
+    }
+
+    initialize_channel_quantizer();
+    long mismatches = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]) && mismatches >= 0; k++) {
+        uint8_t* reference = run_kernel_copy(kernels[k].serial, rgb, width, height, 1);
+        if (!reference) {
+            mismatches = -1;
+            break;
+        }
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]) && mismatches >= 0; t++) {
+            const DiffusionKernel variants[] = { kernels[k].serial, kernels[k].channel };
+            for (int v = 0; v < 2; v++) {
+                uint8_t* indices = run_kernel_copy(variants[v], rgb, width, height, thread_counts[t]);
+                if (!indices) {
+                    mismatches = -1;
+                    break;
+                }
+                for (size_t i = 0; i < pixel_count; i++) {
+                    mismatches += indices[i] != reference[i];
+                }
+                free(indices);
+            }
+        }
+        free(reference);
+    }
+    free(rgb);
+    return mismatches;
 }
\ No newline at end of file
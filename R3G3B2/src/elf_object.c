@@ -0,0 +1,335 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "constrains.h"
+#include "elf_object.h"
+#include "error.h"
+
+// The few ELF constants used here, from the System V gABI and the processor supplements
+#define ET_REL        1
+#define SHT_PROGBITS  1
+#define SHT_SYMTAB    2
+#define SHT_STRTAB    3
+#define SHT_RELA      4
+#define SHT_REL       9
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define SHF_INFO_LINK 0x40
+#define STB_LOCAL     0
+#define STB_GLOBAL    1
+#define STT_OBJECT    1
+#define STT_SECTION   3
+
+#define ELF_SYMBOL_INFO(bind, type) (uint8_t)(((bind) << 4) | (type))
+
+// Every supported target is little-endian, so only the word size and relocation differ
+typedef struct {
+    ElfArch arch;
+    const char* name;
+    bool is_64;
+    uint16_t machine;
+    uint32_t flags;
+    bool rela;             // Addends in the relocation entries rather than in the section
+    uint32_t pointer_reloc; // Absolute relocation of a pointer-sized word
+} ElfTarget;
+
+static const ElfTarget ELF_TARGETS[] = {
+    { ELF_ARCH_X86,     "x86",     false, 3,   0,          false, 1   }, // R_386_32
+    { ELF_ARCH_X86_64,  "x86_64",  true,  62,  0,          true,  1   }, // R_X86_64_64
+    { ELF_ARCH_ARM,     "arm",     false, 40,  0x05000000, false, 2   }, // EABI version 5, R_ARM_ABS32
+    { ELF_ARCH_AARCH64, "aarch64", true,  183, 0,          true,  257 }, // R_AARCH64_ABS64
+    { ELF_ARCH_RISCV32, "riscv32", false, 243, 0x0,        true,  1   }, // ilp32 (soft float), R_RISCV_32
+    { ELF_ARCH_RISCV64, "riscv64", true,  243, 0x4,        true,  2   }  // lp64d (double float), R_RISCV_64
+};
+
+#define ELF_TARGET_COUNT (int)(sizeof(ELF_TARGETS) / sizeof(ELF_TARGETS[0]))
+
+static const ElfTarget* find_target(ElfArch arch)
+{
+    for (int i = 0; i < ELF_TARGET_COUNT; i++) {
+        if (ELF_TARGETS[i].arch == arch) return &ELF_TARGETS[i];
+    }
+    return NULL;
+}
+
+const char* elf_arch_name(ElfArch arch)
+{
+    const ElfTarget* target = find_target(arch);
+    return target ? target->name : NULL;
+}
+
+ElfArch elf_arch_from_name(const char* name)
+{
+    for (int i = 0; name && i < ELF_TARGET_COUNT; i++) {
+        if (strcmp(ELF_TARGETS[i].name, name) == 0) return ELF_TARGETS[i].arch;
+    }
+    return ELF_ARCH_NONE;
+}
+
+// Little-endian bytes of part of the file; base is the file offset of bytes[0]
+typedef struct {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+    size_t base;
+    bool failed;
+} ByteBuffer;
+
+static void put_bytes(ByteBuffer* buffer, const void* bytes, size_t count)
+{
+    if (buffer->failed) return;
+    if (buffer->size + count > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        while (capacity < buffer->size + count) capacity *= 2;
+        uint8_t* grown = (uint8_t*)realloc(buffer->bytes, capacity);
+        if (!grown) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->bytes = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->bytes + buffer->size, bytes, count);
+    buffer->size += count;
+}
+
+static void put_u8(ByteBuffer* buffer, uint8_t value)
+{
+    put_bytes(buffer, &value, 1);
+}
+
+static void put_u16(ByteBuffer* buffer, uint16_t value)
+{
+    const uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    put_bytes(buffer, bytes, 2);
+}
+
+static void put_u32(ByteBuffer* buffer, uint32_t value)
+{
+    put_u16(buffer, (uint16_t)value);
+    put_u16(buffer, (uint16_t)(value >> 16));
+}
+
+// An address, offset or size: 4 bytes in ELF32, 8 in ELF64
+static void put_word(ByteBuffer* buffer, const ElfTarget* target, uint64_t value)
+{
+    put_u32(buffer, (uint32_t)value);
+    if (target->is_64) put_u32(buffer, (uint32_t)(value >> 32));
+}
+
+static size_t buffer_position(const ByteBuffer* buffer)
+{
+    return buffer->base + buffer->size;
+}
+
+static void pad_to(ByteBuffer* buffer, size_t alignment)
+{
+    while (!buffer->failed && buffer_position(buffer) % alignment != 0) put_u8(buffer, 0);
+}
+
+// Appends a NUL terminated string to a string table and returns its offset there
+static uint32_t add_string(ByteBuffer* table, const char* string)
+{
+    const uint32_t offset = (uint32_t)table->size;
+    put_bytes(table, string, strlen(string) + 1);
+    return offset;
+}
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void put_section_header(ByteBuffer* buffer, const ElfTarget* target, uint32_t name, uint32_t type, uint64_t flags,
+                               uint64_t offset, uint64_t size, uint32_t link, uint32_t info, uint64_t alignment, uint64_t entry_size)
+{
+    put_u32(buffer, name);
+    put_u32(buffer, type);
+    put_word(buffer, target, flags);
+    put_word(buffer, target, 0); // Address, none in a relocatable file
+    put_word(buffer, target, offset);
+    put_word(buffer, target, size);
+    put_u32(buffer, link);
+    put_u32(buffer, info);
+    put_word(buffer, target, alignment);
+    put_word(buffer, target, entry_size);
+}
+
+static void put_symbol(ByteBuffer* buffer, const ElfTarget* target, uint32_t name, uint8_t info, uint16_t section, uint64_t value, uint64_t size)
+{
+    put_u32(buffer, name);
+    if (target->is_64) {
+        put_u8(buffer, info);
+        put_u8(buffer, 0);
+        put_u16(buffer, section);
+        put_word(buffer, target, value);
+        put_word(buffer, target, size);
+    }
+    else {
+        put_word(buffer, target, value);
+        put_word(buffer, target, size);
+        put_u8(buffer, info);
+        put_u8(buffer, 0);
+        put_u16(buffer, section);
+    }
+}
+
+/*
+ * File layout: ELF header, the pixel section (with the descriptor after the pixels when they share
+ * a section), the descriptor section, relocations, symbols, strings and the section headers.
+ * Everything but the pixels is built in memory; the pixels are written straight from data.
+ */
+int write_elf_object(FILE* fp, ElfArch arch, const char* symbol, const uint8_t* data, int width, int height, const char* section, int alignment)
+{
+    const ElfTarget* target = find_target(arch);
+    if (!fp || !target || !symbol || !data) {
+        return fileio_error("Null pointer passed to write_elf_object.");
+    }
+
+    const size_t word_size = target->is_64 ? 8 : 4;
+    const size_t header_size = target->is_64 ? 64 : 52;
+    const size_t section_header_size = target->is_64 ? 64 : 40;
+    const size_t symbol_size = target->is_64 ? 24 : 16;
+    const size_t reloc_size = target->rela ? 3 * word_size : 2 * word_size;
+    const size_t pixel_count = (size_t)width * height;
+    const size_t descriptor_size = align_up(word_size + 3 * sizeof(uint16_t), word_size);
+
+    // Section indices; the descriptor shares the pixel section when one is named
+    const bool shared = section != NULL;
+    const uint16_t pixel_index = 1;
+    const uint16_t descriptor_index = shared ? 1 : 2;
+    const uint16_t reloc_index = descriptor_index + 1;
+    const uint16_t symtab_index = reloc_index + 1;
+    const uint16_t strtab_index = symtab_index + 1;
+    const uint16_t note_index = strtab_index + 1;
+    const uint16_t shstrtab_index = note_index + 1;
+    const char* pixel_section = shared ? section : ".rodata";
+    const char* descriptor_section = shared ? section : ".data.rel.ro";
+
+    size_t pixel_alignment = (alignment > 0) ? (size_t)alignment : 1;
+    if (shared && pixel_alignment < word_size) pixel_alignment = word_size;
+    const size_t pixel_offset = align_up(header_size, pixel_alignment);
+    const size_t descriptor_in_section = shared ? align_up(pixel_count, word_size) : 0;
+
+    ByteBuffer strings = { 0 };
+    ByteBuffer section_names = { 0 };
+    ByteBuffer tail = { 0 };
+    ByteBuffer head = { 0 };
+    int result = EXIT_FAILURE;
+
+    char name[MAX_FILENAME_LENGTH + 16];
+    add_string(&strings, "");
+    snprintf(name, sizeof(name), "%s_data", symbol);
+    const uint32_t data_name = add_string(&strings, name);
+    snprintf(name, sizeof(name), "%s_image", symbol);
+    const uint32_t image_name = add_string(&strings, name);
+
+    add_string(&section_names, "");
+    const uint32_t pixel_section_name = add_string(&section_names, pixel_section);
+    const uint32_t descriptor_section_name = shared ? pixel_section_name : add_string(&section_names, descriptor_section);
+    snprintf(name, sizeof(name), "%s%s", target->rela ? ".rela" : ".rel", descriptor_section);
+    const uint32_t reloc_name = add_string(&section_names, name);
+    const uint32_t symtab_name = add_string(&section_names, ".symtab");
+    const uint32_t strtab_name = add_string(&section_names, ".strtab");
+    const uint32_t note_name = add_string(&section_names, ".note.GNU-stack"); // No executable stack needed
+    const uint32_t shstrtab_name = add_string(&section_names, ".shstrtab");
+
+    // Everything after the pixels
+    tail.base = pixel_offset + pixel_count;
+
+    pad_to(&tail, word_size);
+    const size_t descriptor_offset = buffer_position(&tail);
+    put_word(&tail, target, 0); // data, relocated; a REL addend lives here and is 0
+    put_u16(&tail, (uint16_t)width);
+    put_u16(&tail, (uint16_t)height);
+    put_u16(&tail, RGB332_FORMAT_ID);
+
+    pad_to(&tail, word_size);
+    const size_t reloc_offset = buffer_position(&tail);
+    const uint64_t reloc_symbol = 1; // The pixel section's symbol
+    put_word(&tail, target, descriptor_in_section);
+    put_word(&tail, target, target->is_64 ? (reloc_symbol << 32) | target->pointer_reloc : (reloc_symbol << 8) | target->pointer_reloc);
+    if (target->rela) put_word(&tail, target, 0);
+
+    pad_to(&tail, word_size);
+    const size_t symtab_offset = buffer_position(&tail);
+    put_symbol(&tail, target, 0, 0, 0, 0, 0);
+    put_symbol(&tail, target, 0, ELF_SYMBOL_INFO(STB_LOCAL, STT_SECTION), pixel_index, 0, 0);
+    put_symbol(&tail, target, data_name, ELF_SYMBOL_INFO(STB_GLOBAL, STT_OBJECT), pixel_index, 0, pixel_count);
+    put_symbol(&tail, target, image_name, ELF_SYMBOL_INFO(STB_GLOBAL, STT_OBJECT), descriptor_index, descriptor_in_section, descriptor_size);
+    const uint32_t first_global = 2;
+
+    const size_t strtab_offset = buffer_position(&tail);
+    if (!strings.failed) put_bytes(&tail, strings.bytes, strings.size);
+    const size_t shstrtab_offset = buffer_position(&tail);
+    if (!section_names.failed) put_bytes(&tail, section_names.bytes, section_names.size);
+
+    pad_to(&tail, word_size);
+    const size_t section_headers_offset = buffer_position(&tail);
+    put_section_header(&tail, target, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    if (shared) {
+        put_section_header(&tail, target, pixel_section_name, SHT_PROGBITS, SHF_ALLOC, pixel_offset,
+                           descriptor_in_section + descriptor_size, 0, 0, pixel_alignment, 0);
+    }
+    else {
+        put_section_header(&tail, target, pixel_section_name, SHT_PROGBITS, SHF_ALLOC, pixel_offset, pixel_count, 0, 0, pixel_alignment, 0);
+        put_section_header(&tail, target, descriptor_section_name, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, descriptor_offset, descriptor_size, 0, 0, word_size, 0);
+    }
+    put_section_header(&tail, target, reloc_name, target->rela ? SHT_RELA : SHT_REL, SHF_INFO_LINK, reloc_offset, reloc_size,
+                       symtab_index, descriptor_index, word_size, reloc_size);
+    put_section_header(&tail, target, symtab_name, SHT_SYMTAB, 0, symtab_offset, 4 * symbol_size, strtab_index, first_global, word_size, symbol_size);
+    put_section_header(&tail, target, strtab_name, SHT_STRTAB, 0, strtab_offset, strings.size, 0, 0, 1, 0);
+    put_section_header(&tail, target, note_name, SHT_PROGBITS, 0, shstrtab_offset, 0, 0, 0, 1, 0);
+    put_section_header(&tail, target, shstrtab_name, SHT_STRTAB, 0, shstrtab_offset, section_names.size, 0, 0, 1, 0);
+
+    static const uint8_t magic[4] = { 0x7F, 'E', 'L', 'F' };
+    static const uint8_t ident_padding[9] = { 0 }; // System V ABI, ABI version 0, padding
+    put_bytes(&head, magic, sizeof(magic));
+    put_u8(&head, target->is_64 ? 2 : 1); // Class
+    put_u8(&head, 1);                     // Little-endian
+    put_u8(&head, 1);                     // Version
+    put_bytes(&head, ident_padding, sizeof(ident_padding));
+    put_u16(&head, ET_REL);
+    put_u16(&head, target->machine);
+    put_u32(&head, 1);
+    put_word(&head, target, 0); // Entry point
+    put_word(&head, target, 0); // Program headers
+    put_word(&head, target, section_headers_offset);
+    put_u32(&head, target->flags);
+    put_u16(&head, (uint16_t)header_size);
+    put_u16(&head, 0);
+    put_u16(&head, 0);
+    put_u16(&head, (uint16_t)section_header_size);
+    put_u16(&head, shstrtab_index + 1);
+    put_u16(&head, shstrtab_index);
+    pad_to(&head, pixel_alignment);
+
+    if (head.failed || tail.failed || strings.failed || section_names.failed) {
+        fileio_error("Failed to allocate ELF object buffers.");
+        goto cleanup;
+    }
+    if (fwrite(head.bytes, 1, head.size, fp) != head.size ||
+        fwrite(data, 1, pixel_count, fp) != pixel_count ||
+        fwrite(tail.bytes, 1, tail.size, fp) != tail.size) {
+        fileio_perror("Failed to write to file");
+        goto cleanup;
+    }
+    result = EXIT_SUCCESS;
+
+cleanup:
+    free(head.bytes);
+    free(tail.bytes);
+    free(strings.bytes);
+    free(section_names.bytes);
+    return result;
+}
\ No newline at end of file
@@ -5,15 +5,32 @@
  * http://creativecommons.org/publicdomain/zero/1.0/     *
  *                                                       *
  *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L // open_memstream and fmemopen
+#endif
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "dither.h"
 #include "debug.h"
 #include "constrains.h"
 #include "fileio.h"
 #include "image_typedef.h"
+#include "scanline_reader.h"
+#include "elf_object.h"
 #include "error.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -29,6 +46,21 @@ void free_image_memory(ImageData* image)
     image->data = NULL;
     image->width = 0;
     image->height = 0;
+    image->format = PIXEL_FORMAT_RGB888;
+}
+
+// Called once a kernel has written one index per pixel to the front of an RGB buffer.
+// stb_image allocates with malloc, so the buffer can be shrunk with realloc.
+void compact_indexed_image(ImageData* image)
+{
+    if (!image || !image->data) return;
+
+    size_t pixel_count = (size_t)image->width * image->height;
+    uint8_t* shrunk = (uint8_t*)realloc(image->data, pixel_count ? pixel_count : 1);
+    if (shrunk) {
+        image->data = shrunk;
+    }
+    image->format = PIXEL_FORMAT_INDEXED8;
 }
 
 int load_image(const char* filename, ImageData* image)
@@ -39,14 +71,209 @@ int load_image(const char* filename, ImageData* image)
     }
 
     image->data = stbi_load(filename, &image->width, &image->height, &n, RGB_COMPONENTS);
+    image->format = PIXEL_FORMAT_RGB888;
 
     if (!image->data) {
-        fprintf(stderr, "Failed to load image: %s\n", filename);
-        return EXIT_FAILURE;
+        // The scanline reader also knows PAM (P7) files
+        ScanlineReader* reader = scanline_reader_open(filename);
+        if (!reader) {
+            return EXIT_FAILURE;
+        }
+        int result = scanline_reader_read_image(reader, image);
+        scanline_reader_close(reader);
+        return result;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Bytes read from each file per step of a comparison
+#define COMPARE_CHUNK (64 * 1024)
+
+const char* base_name(const char* path)
+{
+    const char* last_slash = strrchr(path, '/');
+    const char* last_backslash = strrchr(path, '\\');
+    return (last_backslash > last_slash) ? last_backslash + 1 : last_slash ? last_slash + 1 : path;
+}
+
+uint16_t get_u16le(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t get_u32le(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+bool replace_file(const char* from, const char* to)
+{
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0; // rename() fails when to exists
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+bool copy_file_mode(const char* from, const char* to)
+{
+#if defined(_WIN32)
+    (void)from;
+    (void)to;
+    return true;
+#else
+    struct stat status;
+    if (stat(from, &status) != 0) {
+        return errno == ENOENT;
+    }
+    return chmod(to, status.st_mode & 07777) == 0;
+#endif
+}
+
+bool make_directory(const char* path)
+{
+#if defined(_WIN32)
+    return _mkdir(path) == 0 || errno == EEXIST;
+#else
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+// Reads both streams to the end; true when they hold the same bytes
+static bool streams_equal(FILE* first, FILE* second)
+{
+    char* buffers = (char*)malloc(2 * COMPARE_CHUNK);
+    bool equal = buffers != NULL;
+
+    while (equal) {
+        const size_t count = fread(buffers, 1, COMPARE_CHUNK, first);
+        equal = fread(buffers + COMPARE_CHUNK, 1, COMPARE_CHUNK, second) == count && memcmp(buffers, buffers + COMPARE_CHUNK, count) == 0;
+        if (count < COMPARE_CHUNK) {
+            equal = equal && !ferror(first) && !ferror(second);
+            break;
+        }
+    }
+    free(buffers);
+    return equal;
+}
+
+bool files_equal(const char* first, const char* second)
+{
+    FILE* first_fp = fopen(first, "rb");
+    FILE* second_fp = first_fp ? fopen(second, "rb") : NULL;
+    const bool equal = first_fp && second_fp && streams_equal(first_fp, second_fp);
+    if (first_fp) fclose(first_fp);
+    if (second_fp) fclose(second_fp);
+    return equal;
+}
+
+int current_process_id(void)
+{
+#if defined(_WIN32)
+    return _getpid();
+#else
+    return (int)getpid();
+#endif
+}
+
+void temporary_filename(const char* filename, char* dest, size_t dest_size)
+{
+    snprintf(dest, dest_size, "%s.tmp%d", filename, current_process_id());
+}
+
+static int output_open(OutputFile* output, const char* filename, bool binary, bool if_changed)
+{
+    memset(output, 0, sizeof(OutputFile));
+    if (strlen(filename) >= MAX_FILENAME_LENGTH) {
+        return fileio_error("Output file name is too long.");
+    }
+    strcpy(output->filename, filename);
+    output->if_changed = if_changed;
+
+    if (!if_changed) {
+        output->fp = fopen(filename, binary ? "wb" : "w");
+    }
+    else {
+#if defined(_WIN32)
+        char temporary[TEMPORARY_FILENAME_LENGTH];
+        temporary_filename(filename, temporary, sizeof(temporary));
+        output->fp = fopen(temporary, binary ? "wb" : "w");
+#else
+        output->fp = open_memstream(&output->memory, &output->memory_size);
+#endif
+    }
+    if (!output->fp) {
+        return fileio_perror("Failed to open output file");
     }
     return EXIT_SUCCESS;
 }
 
+// Closes without replacing anything a write-if-changed output would have replaced
+static void output_discard(OutputFile* output)
+{
+    if (!output->fp) return;
+    fclose(output->fp);
+    output->fp = NULL;
+#if defined(_WIN32)
+    if (output->if_changed) {
+        char temporary[TEMPORARY_FILENAME_LENGTH];
+        temporary_filename(output->filename, temporary, sizeof(temporary));
+        remove(temporary);
+    }
+#else
+    free(output->memory);
+    output->memory = NULL;
+#endif
+}
+
+// Finishes the file, reporting its size; a failed flush is a failed write
+static int output_commit(OutputFile* output, size_t* bytes_written)
+{
+    if (fflush(output->fp) != 0) {
+        output_discard(output);
+        return fileio_perror("Failed to write to file");
+    }
+    const long size = ftell(output->fp);
+    if (bytes_written) {
+        *bytes_written = (size >= 0) ? (size_t)size : 0;
+    }
+    if (!output->if_changed) {
+        const bool closed = fclose(output->fp) == 0;
+        output->fp = NULL;
+        return closed ? EXIT_SUCCESS : fileio_perror("Failed to write to file");
+    }
+
+    char temporary[TEMPORARY_FILENAME_LENGTH];
+    temporary_filename(output->filename, temporary, sizeof(temporary));
+    int result = EXIT_SUCCESS;
+#if defined(_WIN32)
+    const bool closed = fclose(output->fp) == 0;
+    output->fp = NULL;
+    if (closed && files_equal(temporary, output->filename)) {
+        remove(temporary);
+    }
+    else if (!closed || !replace_file(temporary, output->filename)) {
+        remove(temporary);
+        result = fileio_perror("Failed to write to file");
+    }
+#else
+    fclose(output->fp);
+    output->fp = NULL;
+
+    FILE* existing = fopen(output->filename, "rb");
+    FILE* built = output->memory_size ? fmemopen(output->memory, output->memory_size, "rb") : NULL;
+    const bool unchanged = existing && built && streams_equal(built, existing);
+    if (existing) fclose(existing);
+    if (built) fclose(built);
+
+    if (!unchanged) {
+        FILE* fp = fopen(temporary, "wb");
+        bool written = fp && fwrite(output->memory, 1, output->memory_size, fp) == output->memory_size;
+        if (fp && fclose(fp) != 0) written = false;
+        if (!written || !copy_file_mode(output->filename, temporary) || !replace_file(temporary, output->filename)) {
+            remove(temporary);
+            result = fileio_perror("Failed to write to file");
+        }
+    }
+    free(output->memory);
+    output->memory = NULL;
+#endif
+    return result;
+}
+
 static const char* image_types_header =
 "#ifndef IMAGE_TYPES_H\n"
 "#define IMAGE_TYPES_H\n\n"
@@ -74,37 +301,392 @@ static int write_c_header(FILE* fp, const char* array_name)
     return EXIT_SUCCESS;
 }
 
-static int write_image_data(FILE* fp, const char* array_name, const ImageData* image)
+static const char* path_basename(const char* path)
+{
+    const char* last_slash = strrchr(path, '/');
+    const char* last_backslash = strrchr(path, '\\');
+    return (last_backslash > last_slash) ? last_backslash + 1 : last_slash ? last_slash + 1 : path;
+}
+
+// The .c file of a split header: the header's name with its extension replaced by .c
+static int source_filename(const char* header_filename, char* dest, size_t dest_size)
 {
-    if (!fp || !array_name || !image || !image->data) {
+    const char* dot = strrchr(path_basename(header_filename), '.');
+    const int stem_length = dot ? (int)(dot - header_filename) : (int)strlen(header_filename);
+
+    const int written = snprintf(dest, dest_size, "%.*s.c", stem_length, header_filename);
+    if (written < 0 || (size_t)written >= dest_size) {
+        return fileio_error("Source file name is too long.");
+    }
+    if (strcmp(dest, header_filename) == 0) {
+        return fileio_error("The header of a split output cannot itself be a .c file.");
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * "static const uint8_t X_data[N]" and the like, up to the initializer. A split output defines the
+ * array once in its .c file, so there it has external linkage instead. Placement attributes go
+ * after the declarator, where GCC and Clang accept them.
+ */
+static int write_array_declaration(FILE* fp, const OutputFormat* format, const char* type, const char* array_name, const char* suffix, size_t count)
+{
+    if (fprintf(fp, "%sconst %s %s_%s[%zu]", format->split_source ? "" : "static ", type, array_name, suffix, count) < 0) return fileio_perror("Failed to write to file");
+
+    if (format->section && format->alignment > 0) {
+        if (fprintf(fp, " __attribute__((section(\"%s\"), aligned(%d)))", format->section, format->alignment) < 0) return fileio_perror("Failed to write to file");
+    }
+    else if (format->section) {
+        if (fprintf(fp, " __attribute__((section(\"%s\")))", format->section) < 0) return fileio_perror("Failed to write to file");
+    }
+    else if (format->alignment > 0) {
+        if (fprintf(fp, " __attribute__((aligned(%d)))", format->alignment) < 0) return fileio_perror("Failed to write to file");
+    }
+    return EXIT_SUCCESS;
+}
+
+// All a split header holds besides the types: includers neither parse nor store the pixels
+static int write_extern_declarations(FILE* fp, const char* array_name, size_t count, HeaderEncoding encoding)
+{
+    if (encoding == HEADER_ENCODING_WORDS) {
+        if (fprintf(fp, "extern const uint32_t %s_words[%zu];\n", array_name, (count + 3) / 4) < 0) return fileio_perror("Failed to write to file");
+    }
+    else if (fprintf(fp, "extern const uint8_t %s_data[%zu];\n", array_name, count) < 0) {
+        return fileio_perror("Failed to write to file");
+    }
+    if (fprintf(fp, "extern const Image_t %s_image;\n\n", array_name) < 0) return fileio_perror("Failed to write to file");
+    return EXIT_SUCCESS;
+}
+
+static int write_image_data_open(FILE* fp, const char* array_name, int width, int height, const OutputFormat* format)
+{
+    if (write_array_declaration(fp, format, "uint8_t", array_name, "data", (size_t)width * height) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (fprintf(fp, " = {\n") < 0) return fileio_perror("Failed to write to file");
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Every pixel is emitted as "0xAB, " and every row ends in a newline, the text fprintf("0x%.2X, ")
+ * used to produce. The six characters of each byte value come from a 256-entry table, so a row is
+ * formatted with plain copies into a buffer and a whole run of rows is written at once.
+ */
+#define HEX_ENTRY_SIZE 6
+
+// Bytes of text per chunk of rows that a worker formats in one go
+#define HEX_CHUNK_BYTES (256 * 1024)
+
+// Chunks per worker formatted before the batch is written
+#define HEX_CHUNKS_PER_WORKER 4
+
+typedef struct {
+    char entry[256][HEX_ENTRY_SIZE];
+} HexTable;
+
+// The strings are exactly HEX_ENTRY_SIZE characters, so no terminator is stored
+#define HEX_ENTRIES(hi) "0x" #hi "0, ", "0x" #hi "1, ", "0x" #hi "2, ", "0x" #hi "3, ", \
+                        "0x" #hi "4, ", "0x" #hi "5, ", "0x" #hi "6, ", "0x" #hi "7, ", \
+                        "0x" #hi "8, ", "0x" #hi "9, ", "0x" #hi "A, ", "0x" #hi "B, ", \
+                        "0x" #hi "C, ", "0x" #hi "D, ", "0x" #hi "E, ", "0x" #hi "F, "
+
+static const HexTable HEX_TABLE = { {
+    HEX_ENTRIES(0), HEX_ENTRIES(1), HEX_ENTRIES(2), HEX_ENTRIES(3),
+    HEX_ENTRIES(4), HEX_ENTRIES(5), HEX_ENTRIES(6), HEX_ENTRIES(7),
+    HEX_ENTRIES(8), HEX_ENTRIES(9), HEX_ENTRIES(A), HEX_ENTRIES(B),
+    HEX_ENTRIES(C), HEX_ENTRIES(D), HEX_ENTRIES(E), HEX_ENTRIES(F)
+} };
+
+static size_t hex_row_size(int width)
+{
+    return (size_t)width * HEX_ENTRY_SIZE + 1;
+}
+
+// Formats row_count rows into out, which must hold row_count * hex_row_size(width) bytes
+static void format_hex_rows(const uint8_t* rows, int width, int row_count, char* out)
+{
+    for (int y = 0; y < row_count; y++) {
+        for (int x = 0; x < width; x++, out += HEX_ENTRY_SIZE) {
+            memcpy(out, HEX_TABLE.entry[*rows++], HEX_ENTRY_SIZE);
+        }
+        *out++ = '\n';
+    }
+}
+
+static int write_image_data_row(FILE* fp, const uint8_t* row, int width)
+{
+    char line[256 * HEX_ENTRY_SIZE + 1];
+
+    // Long rows go out in pieces of 256 pixels, with the newline after the last one
+    for (int x = 0; x < width; x += 256) {
+        const int count = (width - x < 256) ? width - x : 256;
+        format_hex_rows(row + x, count, 1, line);
+        const size_t size = (size_t)count * HEX_ENTRY_SIZE + ((x + count == width) ? 1 : 0);
+        if (fwrite(line, 1, size, fp) != size) return fileio_perror("Failed to write to file");
+    }
+    return EXIT_SUCCESS;
+}
+
+static int write_image_data_close(FILE* fp)
+{
+    if (fprintf(fp, "};\n\n") < 0) return fileio_perror("Failed to write to file");
+    return EXIT_SUCCESS;
+}
+
+typedef struct {
+    const uint8_t* data;    // First row of the batch
+    int width;
+    int rows;               // Rows in the batch
+    int rows_per_chunk;
+    char* text;             // Chunk c starts at c * rows_per_chunk rows of text, so the batch is contiguous
+    volatile int next_chunk;
+} HexFormatJob;
+
+static void hex_format_worker(void* context, int worker_index)
+{
+    HexFormatJob* job = (HexFormatJob*)context;
+    const size_t row_size = hex_row_size(job->width);
+    (void)worker_index;
+
+    for (;;) {
+        const int y = pool_atomic_fetch_add(&job->next_chunk, 1) * job->rows_per_chunk;
+        if (y >= job->rows) break;
+        const int count = (job->rows - y < job->rows_per_chunk) ? job->rows - y : job->rows_per_chunk;
+        format_hex_rows(job->data + (size_t)y * job->width, job->width, count, job->text + (size_t)y * row_size);
+    }
+}
+
+static int write_image_data(FILE* fp, const char* array_name, const uint8_t* data, int width, int height, const OutputFormat* format, ThreadPool* pool)
+{
+    if (!fp || !array_name || !data) {
         return fileio_error("Null pointer passed to write_image_data.");
     }
 
-    if (fprintf(fp, "static const uint8_t %s_data[%zu] = {\n", array_name, (size_t)image->width * image->height) < 0) return fileio_perror("Failed to write to file");
+    if (write_image_data_open(fp, array_name, width, height, format) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    const size_t row_size = hex_row_size(width);
+    const int rows_per_chunk = (row_size < HEX_CHUNK_BYTES) ? (int)(HEX_CHUNK_BYTES / row_size) : 1;
+    const long long batch = (long long)rows_per_chunk * HEX_CHUNKS_PER_WORKER * thread_pool_size(pool);
+    const int batch_rows = (batch < height) ? (int)batch : height;
+
+    char* text = (char*)malloc((size_t)batch_rows * row_size + 1);
+    if (!text) {
+        return fileio_error("Failed to allocate header text buffer.");
+    }
+
+    // Chunks of a batch are formatted in parallel, then the batch is written in order
+    for (int y = 0; y < height; y += batch_rows) {
+        HexFormatJob job = { 0 };
+        job.data = data + (size_t)y * width;
+        job.width = width;
+        job.rows = (height - y < batch_rows) ? height - y : batch_rows;
+        job.rows_per_chunk = rows_per_chunk;
+        job.text = text;
+        thread_pool_run(pool, hex_format_worker, &job);
+
+        const size_t size = (size_t)job.rows * row_size;
+        if (fwrite(text, 1, size, fp) != size) {
+            free(text);
+            return fileio_perror("Failed to write to file");
+        }
+    }
+    free(text);
+    return write_image_data_close(fp);
+}
+
+/*
+ * Compilers spend most of their time on a large header tokenizing its initializer list. A string
+ * literal is a single token however long it is, and a word holds four pixels per token, so both
+ * parse many times faster; #embed leaves the bytes in a file the compiler reads directly.
+ */
+
+// Printable characters stand for themselves; the rest become three-digit octal escapes, which
+// cannot swallow a digit that follows them. '?' is escaped so no trigraph can form.
+static size_t escape_string_byte(uint8_t value, char* out)
+{
+    if (value >= 0x20 && value < 0x7F && value != '"' && value != '\\' && value != '?') {
+        out[0] = (char)value;
+        return 1;
+    }
+    out[0] = '\\';
+    out[1] = (char)('0' + (value >> 6));
+    out[2] = (char)('0' + ((value >> 3) & 7));
+    out[3] = (char)('0' + (value & 7));
+    return 4;
+}
+
+// The array is exactly as long as the pixels, so the literal's terminating NUL is not stored
+static int write_string_data(FILE* fp, const char* array_name, const uint8_t* data, int width, int height, const OutputFormat* format)
+{
+    char* line = (char*)malloc((size_t)width * 4 + 4);
+    if (!line) {
+        return fileio_error("Failed to allocate header text buffer.");
+    }
 
-    for (size_t y = 0; y < image->height; y++) {
-        for (size_t x = 0; x < image->width; x++) {
-            size_t idx = (y * image->width + x) * RGB_COMPONENTS;
-            uint8_t rgb332 = rgbToRgb332(image->data[idx], image->data[idx + 1], image->data[idx + 2]);
-            if (fprintf(fp, "0x%.2X, ", rgb332) < 0) return fileio_perror("Failed to write to file");
+    int result = write_array_declaration(fp, format, "uint8_t", array_name, "data", (size_t)width * height);
+    if (result == EXIT_SUCCESS && fprintf(fp, " =\n") < 0) result = fileio_perror("Failed to write to file");
+    for (int y = 0; y < height && result == EXIT_SUCCESS; y++) {
+        size_t length = 0;
+        line[length++] = '"';
+        for (int x = 0; x < width; x++) {
+            length += escape_string_byte(data[(size_t)y * width + x], line + length);
         }
-        if (fprintf(fp, "\n") < 0) return fileio_perror("Failed to write to file");
+        line[length++] = '"';
+        line[length++] = '\n';
+        if (fwrite(line, 1, length, fp) != length) result = fileio_perror("Failed to write to file");
+    }
+    if (result == EXIT_SUCCESS && fprintf(fp, ";\n\n") < 0) result = fileio_perror("Failed to write to file");
+    free(line);
+    return result;
+}
+
+// Words per line of the word encoding
+#define WORDS_PER_LINE 8
+
+// Pixel i is byte i % 4 of word i / 4, counting from the least significant byte, so the
+// array reads back as the pixel bytes on a little-endian target. The last word is zero padded.
+static int write_word_data(FILE* fp, const char* array_name, const uint8_t* data, size_t count, const OutputFormat* format)
+{
+    const size_t words = (count + 3) / 4;
+    char line[WORDS_PER_LINE * 12 + 2];
+
+    if (fprintf(fp, "/* Four pixels per word, first pixel in the low byte; needs a little-endian target */\n") < 0) return fileio_perror("Failed to write to file");
+    if (write_array_declaration(fp, format, "uint32_t", array_name, "words", words) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (fprintf(fp, " = {\n") < 0) return fileio_perror("Failed to write to file");
+
+    for (size_t w = 0; w < words; w += WORDS_PER_LINE) {
+        const size_t line_words = (words - w < WORDS_PER_LINE) ? words - w : WORDS_PER_LINE;
+        char* out = line;
+        for (size_t i = 0; i < line_words; i++) {
+            uint8_t bytes[4] = { 0, 0, 0, 0 };
+            const size_t first = (w + i) * 4;
+            memcpy(bytes, data + first, (count - first < 4) ? count - first : 4);
+
+            *out++ = '0';
+            *out++ = 'x';
+            for (int b = 3; b >= 0; b--) {
+                memcpy(out, HEX_TABLE.entry[bytes[b]] + 2, 2);
+                out += 2;
+            }
+            *out++ = ',';
+            *out++ = ' ';
+        }
+        *out++ = '\n';
+        if (fwrite(line, 1, (size_t)(out - line), fp) != (size_t)(out - line)) return fileio_perror("Failed to write to file");
     }
 
     if (fprintf(fp, "};\n\n") < 0) return fileio_perror("Failed to write to file");
     return EXIT_SUCCESS;
 }
 
-static int write_image_struct(FILE* fp, const char* array_name, const ImageData* image)
+// The raw pixel file #embed reads: <array_name>_pixels.bin next to the header
+static int embed_filename(const char* header_filename, const char* array_name, char* dest, size_t dest_size)
+{
+    const int directory_length = (int)(path_basename(header_filename) - header_filename);
+
+    const int written = snprintf(dest, dest_size, "%.*s%s_pixels.bin", directory_length, header_filename, array_name);
+    if (written < 0 || (size_t)written >= dest_size) {
+        return fileio_error("Embedded data file name is too long.");
+    }
+    return EXIT_SUCCESS;
+}
+
+// The raw pixel file beside a header or .S file, for #embed and .incbin
+static int write_pixel_file(const char* filename, const char* array_name, const uint8_t* data, size_t count, const OutputFormat* format)
+{
+    char data_filename[MAX_FILENAME_LENGTH];
+    OutputFile output;
+    if (embed_filename(filename, array_name, data_filename, sizeof(data_filename)) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (output_open(&output, data_filename, true, format->if_changed) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (fwrite(data, 1, count, output.fp) != count) {
+        output_discard(&output);
+        return fileio_perror("Failed to write embedded data file");
+    }
+    return output_commit(&output, NULL);
+}
+
+static int write_embed_data(FILE* fp, const char* filename, const char* array_name, const uint8_t* data, size_t count, const OutputFormat* format)
+{
+    if (write_pixel_file(filename, array_name, data, count, format) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // #embed looks next to the including file first, like #include "..."
+    if (fprintf(fp, "/* Needs C23 #embed (GCC 15, Clang 19 or later) */\n") < 0)                     return fileio_perror("Failed to write to file");
+    if (write_array_declaration(fp, format, "uint8_t", array_name, "data", count) != EXIT_SUCCESS)     return EXIT_FAILURE;
+    if (fprintf(fp, " = {\n") < 0)                                                                   return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "#embed \"%s_pixels.bin\"\n", array_name) < 0)                                     return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "};\n\n") < 0)                                                                    return fileio_perror("Failed to write to file");
+    return EXIT_SUCCESS;
+}
+
+/*
+ * A .S file for the GNU assembler, with the pixels .incbin'd from the same <array_name>_pixels.bin
+ * file #embed uses. It holds the same symbols as an -elf object; the C preprocessor, which gcc runs
+ * on .S files, picks the pointer size of the target.
+ */
+static int write_asm_data(FILE* fp, const char* filename, const char* array_name, const uint8_t* data, int width, int height, const OutputFormat* format)
+{
+    const size_t count = (size_t)width * height;
+    if (write_pixel_file(filename, array_name, data, count, format) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // The descriptor follows the pixels into a named section, as in write_elf_object
+    if (fprintf(fp, "/* Assemble with gcc -c; .incbin looks in the current directory and the -I directories */\n\n") < 0) return fileio_perror("Failed to write to file");
+    if (format->section) {
+        if (fprintf(fp, "    .section %s, \"a\"\n", format->section) < 0)       return fileio_perror("Failed to write to file");
+    }
+    else if (fprintf(fp, "    .section .rodata\n") < 0) {
+        return fileio_perror("Failed to write to file");
+    }
+    if (format->alignment > 0 && fprintf(fp, "    .balign %d\n", format->alignment) < 0) return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .global %s_data\n", array_name) < 0)                  return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .type %s_data, %%object\n", array_name) < 0)          return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "%s_data:\n", array_name) < 0)                             return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .incbin \"%s_pixels.bin\"\n", array_name) < 0)        return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .size %s_data, %zu\n\n", array_name, count) < 0)     return fileio_perror("Failed to write to file");
+
+    if (!format->section && fprintf(fp, "    .section .data.rel.ro, \"aw\"\n") < 0) return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .balign __SIZEOF_POINTER__\n") < 0)                  return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .global %s_image\n", array_name) < 0)                 return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .type %s_image, %%object\n", array_name) < 0)         return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "%s_image:\n", array_name) < 0)                            return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "#if __SIZEOF_POINTER__ == 8\n    .quad %s_data\n#else\n    .long %s_data\n#endif\n", array_name, array_name) < 0) return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .short %d, %d, 0x%X\n", width, height, RGB332_FORMAT_ID) < 0) return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .balign __SIZEOF_POINTER__\n") < 0)                  return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .size %s_image, . - %s_image\n\n", array_name, array_name) < 0) return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .section .note.GNU-stack, \"\", %%progbits\n") < 0) return fileio_perror("Failed to write to file");
+    return EXIT_SUCCESS;
+}
+
+static int write_encoded_data(FILE* fp, const char* filename, const char* array_name, const uint8_t* data, int width, int height, const OutputFormat* format, ThreadPool* pool)
 {
-    if (!fp || !array_name || !image) {
+    switch (format->encoding) {
+    case HEADER_ENCODING_STRING: return write_string_data(fp, array_name, data, width, height, format);
+    case HEADER_ENCODING_WORDS:  return write_word_data(fp, array_name, data, (size_t)width * height, format);
+    case HEADER_ENCODING_EMBED:  return write_embed_data(fp, filename, array_name, data, (size_t)width * height, format);
+    default:                     return write_image_data(fp, array_name, data, width, height, format, pool);
+    }
+}
+
+static int write_image_struct(FILE* fp, const char* array_name, int width, int height, const OutputFormat* format)
+{
+    if (!fp || !array_name) {
         return fileio_error("Null pointer passed to write_image_struct.");
     }
 
-    if (fprintf(fp, "static const Image_t %s_image = {\n", array_name) < 0) return fileio_perror("Failed to write to file");
-    if (fprintf(fp, "    .data = %s_data,\n", array_name) < 0)              return fileio_perror("Failed to write to file");
-    if (fprintf(fp, "    .width = %d,\n", image->width) < 0)                return fileio_perror("Failed to write to file");
-    if (fprintf(fp, "    .height = %d,\n", image->height) < 0)              return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "%sconst Image_t %s_image = {\n", format->split_source ? "" : "static ", array_name) < 0) return fileio_perror("Failed to write to file");
+    if (format->encoding == HEADER_ENCODING_WORDS) {
+        if (fprintf(fp, "    .data = (const uint8_t*)%s_words,\n", array_name) < 0) return fileio_perror("Failed to write to file");
+    }
+    else if (fprintf(fp, "    .data = %s_data,\n", array_name) < 0) {
+        return fileio_perror("Failed to write to file");
+    }
+    if (fprintf(fp, "    .width = %d,\n", width) < 0)                       return fileio_perror("Failed to write to file");
+    if (fprintf(fp, "    .height = %d,\n", height) < 0)                     return fileio_perror("Failed to write to file");
     if (fprintf(fp, "    .format_id = RGB332_FORMAT_ID\n") < 0)             return fileio_perror("Failed to write to file");
     if (fprintf(fp, "};\n\n") < 0)                                          return fileio_perror("Failed to write to file");
     return EXIT_SUCCESS;
@@ -120,72 +702,267 @@ static int write_c_footer(FILE* fp, const char* array_name)
 }
 
 
-static int write_binary_data(FILE* fp, const ImageData* image)
+static int write_binary_metadata(FILE* fp, int width, int height)
 {
-    if (!fp || !image || !image->data) {
-        return fileio_error("Null pointer passed to write_binary_data.");
-    }
     // Write binary metadata header
     ImageMetadata metadata;
-    metadata.width = image->width;
-    metadata.height = image->height;
+    metadata.width = width;
+    metadata.height = height;
     metadata.format_id = RGB332_FORMAT_ID; // Use the defined format ID
 
     if (fwrite(&metadata, sizeof(ImageMetadata), 1, fp) != 1) {
         return fileio_perror("Failed to write binary metadata");
     };
+    return EXIT_SUCCESS;
+}
+
+// Indices are already the packed output bytes, so any run of rows goes out in one call
+static int write_binary_rows(FILE* fp, const uint8_t* rows, int width, int height)
+{
+    const size_t size = (size_t)width * height;
+    if (fwrite(rows, 1, size, fp) != size) {
+        return fileio_perror("Failed to write to file");
+    }
+    return EXIT_SUCCESS;
+}
+
+static int write_binary_data(FILE* fp, const uint8_t* data, int width, int height)
+{
+    if (!fp || !data) {
+        return fileio_error("Null pointer passed to write_binary_data.");
+    }
+    if (write_binary_metadata(fp, width, height) != EXIT_SUCCESS) return EXIT_FAILURE;
 
     // Write raw binary data
-    for (size_t y = 0; y < image->height; y++) {
-        for (size_t x = 0; x < image->width; x++) {
-            size_t idx = (y * image->width + x) * RGB_COMPONENTS;
-            uint8_t rgb332 = rgbToRgb332(image->data[idx], image->data[idx + 1], image->data[idx + 2]);
-            if (fwrite(&rgb332, 1, 1, fp) != 1) { // Write 1 byte at a time
-                return fileio_perror("Failed to write to file");
-            }
-        }
+    return write_binary_rows(fp, data, width, height);
+}
+
+/*
+ * Opens the file the pixel array is written to: the header itself, after its preamble, or with
+ * split_source the .c file, once the header has been written in full with extern declarations.
+ * header_bytes receives the size of a header written here, 0 otherwise.
+ */
+static int open_header_output(const char* filename, const char* array_name, int width, int height, const OutputFormat* format, OutputFile* data_output, size_t* header_bytes)
+{
+    char c_filename[MAX_FILENAME_LENGTH];
+    *header_bytes = 0;
+    if (format->split_source && source_filename(filename, c_filename, sizeof(c_filename)) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (output_open(data_output, filename, false, format->if_changed) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (write_c_header(data_output->fp, array_name) != EXIT_SUCCESS) {
+        output_discard(data_output);
+        return EXIT_FAILURE;
+    }
+    if (!format->split_source) {
+        return EXIT_SUCCESS;
+    }
+
+    if (write_extern_declarations(data_output->fp, array_name, (size_t)width * height, format->encoding) != EXIT_SUCCESS ||
+        write_c_footer(data_output->fp, array_name) != EXIT_SUCCESS) {
+        output_discard(data_output);
+        return EXIT_FAILURE;
+    }
+    if (output_commit(data_output, header_bytes) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    if (output_open(data_output, c_filename, false, format->if_changed) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (fprintf(data_output->fp, "#include \"%s\"\n\n", path_basename(filename)) < 0) {
+        output_discard(data_output);
+        return fileio_perror("Failed to write to file");
     }
     return EXIT_SUCCESS;
 }
 
-int write_image_data_to_file(const char* filename, const char* array_name, const ImageData* image, bool header_output, bool bin_output)
+// The image struct after the pixel array, then the include guard's end unless the array is in a .c file
+static int write_header_trailer(FILE* fp, const char* array_name, int width, int height, const OutputFormat* format)
+{
+    if (write_image_struct(fp, array_name, width, height, format) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return format->split_source ? EXIT_SUCCESS : write_c_footer(fp, array_name);
+}
+
+static int write_indexed_data_to_file(const char* filename, const char* array_name, const uint8_t* data, int width, int height, const OutputFormat* format, ThreadPool* pool, size_t* bytes_written)
 {
-    FILE* fp = NULL;
+    OutputFile output = { 0 };
+    size_t header_bytes = 0;
     int result = EXIT_FAILURE;
 
-    if (!filename || !array_name || !image || !image->data) {
+    if (format->bin_output) {
+        if (output_open(&output, filename, true, format->if_changed) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (write_binary_data(output.fp, data, width, height) != EXIT_SUCCESS) goto cleanup;
+    }
+    else if (format->elf_arch != ELF_ARCH_NONE) {
+        if (output_open(&output, filename, true, format->if_changed) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (write_elf_object(output.fp, format->elf_arch, array_name, data, width, height, format->section, format->alignment) != EXIT_SUCCESS) goto cleanup;
+    }
+    else if (format->asm_output) {
+        if (output_open(&output, filename, false, format->if_changed) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (write_asm_data(output.fp, filename, array_name, data, width, height, format) != EXIT_SUCCESS) goto cleanup;
+    }
+    else if (format->header_output) {
+        // Write C header file, and with split_source its .c file
+        if (open_header_output(filename, array_name, width, height, format, &output, &header_bytes) != EXIT_SUCCESS)  return EXIT_FAILURE;
+        if (write_encoded_data(output.fp, filename, array_name, data, width, height, format, pool) != EXIT_SUCCESS)  goto cleanup;
+        if (write_header_trailer(output.fp, array_name, width, height, format) != EXIT_SUCCESS)                     goto cleanup;
+    }
+    else {
+        return fileio_error("Must select -b, -h, -elf or -asm output option");
+    }
+
+    result = output_commit(&output, bytes_written);
+    if (result == EXIT_SUCCESS && bytes_written) {
+        *bytes_written += header_bytes;
+    }
+
+cleanup:
+    output_discard(&output);
+    return result;
+}
+
+int output_file_names(const char* filename, const char* array_name, const OutputFormat* format, char names[MAX_OUTPUT_FILES][MAX_FILENAME_LENGTH])
+{
+    if (!filename || !array_name || !format || strlen(filename) >= MAX_FILENAME_LENGTH) {
+        return -1;
+    }
+
+    int count = 0;
+    strcpy(names[count++], filename);
+    if (format->bin_output || format->elf_arch != ELF_ARCH_NONE) {
+        return count;
+    }
+    if (format->header_output && format->split_source) {
+        if (source_filename(filename, names[count++], MAX_FILENAME_LENGTH) != EXIT_SUCCESS) return -1;
+    }
+    if (format->asm_output || (format->header_output && format->encoding == HEADER_ENCODING_EMBED)) {
+        if (embed_filename(filename, array_name, names[count++], MAX_FILENAME_LENGTH) != EXIT_SUCCESS) return -1;
+    }
+    return count;
+}
+
+// Every output format stores the width and height in 16-bit fields
+static int check_output_size(int width, int height)
+{
+    if (width > UINT16_MAX || height > UINT16_MAX) {
+        fprintf(stderr, "Error: The image is %dx%d, but -b, -h, -elf and -asm output hold at most %dx%d pixels.\n",
+                width, height, UINT16_MAX, UINT16_MAX);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int write_image_data_to_file(const char* filename, const char* array_name, const ImageData* image, const OutputFormat* format, ThreadPool* pool, size_t* bytes_written)
+{
+    if (!filename || !array_name || !image || !image->data || !format) {
         return fileio_error("Null pointer passed to write_image_data_to_file.");
     }
+    if (check_output_size(image->width, image->height) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
 
-    if (bin_output) {
-        fp = fopen(filename, "wb"); // Use "wb" for binary mode
-        if (!fp) {
-            return fileio_perror("Failed to open output file");
-        }
+    if (image->format == PIXEL_FORMAT_INDEXED8) {
+        return write_indexed_data_to_file(filename, array_name, image->data, image->width, image->height, format, pool, bytes_written);
+    }
 
-        if (write_binary_data(fp, image) != EXIT_SUCCESS) goto cleanup;
+    size_t pixel_count = (size_t)image->width * image->height;
+    uint8_t* packed = (uint8_t*)malloc(pixel_count ? pixel_count : 1);
+    if (!packed) {
+        return fileio_error("Failed to allocate packed output buffer.");
+    }
 
+    for (size_t i = 0; i < pixel_count; i++) {
+        packed[i] = rgbToRgb332(image->data[i * RGB_COMPONENTS], image->data[i * RGB_COMPONENTS + 1], image->data[i * RGB_COMPONENTS + 2]);
+    }
+
+    int result = write_indexed_data_to_file(filename, array_name, packed, image->width, image->height, format, pool, bytes_written);
+    free(packed);
+    return result;
+}
+
+int row_writer_open(RowWriter* writer, const char* filename, const char* array_name, int width, int height, const OutputFormat* format)
+{
+    if (!writer || !filename || !array_name || !format) {
+        return fileio_error("Null pointer passed to row_writer_open.");
+    }
+    if (!format->bin_output && !format->header_output) {
+        return fileio_error("Rows can only be written to -b or -h output.");
     }
-    else if (header_output) {
-        fp = fopen(filename, "w");
-        if (!fp) {
-            return fileio_perror("Failed to open output file");
+    if (!format->bin_output && format->encoding != HEADER_ENCODING_BYTES) {
+        return fileio_error("Rows can only be written with the bytes header encoding.");
+    }
+    if (check_output_size(width, height) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    memset(writer, 0, sizeof(RowWriter));
+    writer->array_name = array_name;
+    writer->width = width;
+    writer->height = height;
+    writer->header_output = !format->bin_output; // Binary wins when both are set, as in write_indexed_data_to_file
+    writer->format = *format;
+
+    if (writer->header_output) {
+        if (open_header_output(filename, array_name, width, height, format, &writer->output, &writer->header_bytes) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
         }
-        // Write C header file
-        if (write_c_header(fp, array_name) != EXIT_SUCCESS)            goto cleanup;
-        if (write_image_data(fp, array_name, image) != EXIT_SUCCESS)   goto cleanup;
-        if (write_image_struct(fp, array_name, image) != EXIT_SUCCESS) goto cleanup;
-        if (write_c_footer(fp, array_name) != EXIT_SUCCESS)            goto cleanup;
     }
-    else {
-        return fileio_error("Must select -b or -h output option");
+    else if (output_open(&writer->output, filename, true, format->if_changed) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    int result = writer->header_output ? write_image_data_open(writer->output.fp, array_name, width, height, format)
+                                       : write_binary_metadata(writer->output.fp, width, height);
+    if (result != EXIT_SUCCESS) {
+        row_writer_discard(writer);
     }
+    return result;
+}
 
-    result = EXIT_SUCCESS;
+int row_writer_write(RowWriter* writer, const uint8_t* indices)
+{
+    if (!writer || !writer->output.fp || !indices) {
+        return fileio_error("Null pointer passed to row_writer_write.");
+    }
+    if (writer->rows_written >= writer->height) {
+        return fileio_error("More rows written than the image has.");
+    }
 
-cleanup:
-    if (fp)
-        fclose(fp);
+    writer->rows_written++;
+    return writer->header_output ? write_image_data_row(writer->output.fp, indices, writer->width)
+                                 : write_binary_rows(writer->output.fp, indices, writer->width, 1);
+}
+
+int row_writer_finish(RowWriter* writer)
+{
+    if (!writer || !writer->output.fp) {
+        return fileio_error("Null pointer passed to row_writer_finish.");
+    }
+    if (writer->rows_written != writer->height) {
+        row_writer_discard(writer);
+        return fileio_error("Output closed before every row was written.");
+    }
 
+    int result = EXIT_SUCCESS;
+    if (writer->header_output) {
+        if (write_image_data_close(writer->output.fp) != EXIT_SUCCESS ||
+            write_header_trailer(writer->output.fp, writer->array_name, writer->width, writer->height, &writer->format) != EXIT_SUCCESS) {
+            result = EXIT_FAILURE;
+        }
+    }
+    if (result == EXIT_SUCCESS) {
+        result = output_commit(&writer->output, &writer->bytes_written);
+        writer->bytes_written += writer->header_bytes;
+    }
+    output_discard(&writer->output);
     return result;
+}
+
+void row_writer_discard(RowWriter* writer)
+{
+    if (writer) {
+        output_discard(&writer->output);
+    }
 }
\ No newline at end of file
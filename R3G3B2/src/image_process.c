@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
 
 #include "luts.h"
@@ -17,6 +18,10 @@
 #include "fileio.h"
 #include "debug.h"
 #include "image_process.h"
+#include "convert.h"
+#include "scanline_reader.h"
+#include "mapped_image.h"
+#include "output_cache.h"
 #include "error.h"
 
 static char* trim_filename_copy(const char* filename, char* dest, size_t dest_size)
@@ -30,18 +35,7 @@ static char* trim_filename_copy(const char* filename, char* dest, size_t dest_si
         return dest;
     }
 
-    const char* last_slash = strrchr(filename, '/');
-    const char* last_backslash = strrchr(filename, '\\');
-
-    const char* filename_start = filename; // Default to the beginning
-
-    if (last_slash > last_backslash) {
-        filename_start = last_slash ? last_slash + 1 : filename;
-    }
-    else if (last_backslash > last_slash)
-    {
-        filename_start = last_backslash ? last_backslash + 1 : filename;
-    }
+    const char* filename_start = base_name(filename);
 
     const char* dot = strrchr(filename_start, '.');
     size_t length;
@@ -71,64 +65,243 @@ static char* trim_filename_copy(const char* filename, char* dest, size_t dest_si
     }
 }
 
-int process_image(ProgramOptions* opts)
+int symbol_from_filename(const char* filename, char* dest, size_t dest_size)
 {
-    if (!opts) {
-        return fileio_error("Null pointer passed to process_image.");
+    char stem[MAX_FILENAME_LENGTH];
+    if (dest_size < 2 || trim_filename_copy(filename, stem, sizeof(stem)) == NULL) {
+        return fileio_error("trim_filename_copy failed");
     }
 
-    if (opts->infilename[0] == '\0') {
-        return fileio_error("No input file specified.");
+    size_t length = 0;
+    if (isdigit((unsigned char)stem[0])) {
+        dest[length++] = '_';
+    }
+    for (const char* c = stem; *c != '\0' && length < dest_size - 1; c++) {
+        dest[length++] = (isalnum((unsigned char)*c) || *c == '_') ? *c : '_';
     }
+    dest[length] = '\0';
+    return EXIT_SUCCESS;
+}
 
-    if (opts->outfilename[0] == '\0') {
-        return fileio_error("No output file specified.");
+static OutputFormat output_format(const ProgramOptions* opts)
+{
+    OutputFormat format;
+    format.header_output = opts->header_output;
+    format.bin_output = opts->bin_output;
+    format.encoding = opts->header_encoding;
+    format.split_source = opts->split_source;
+    format.section = (opts->data_section[0] != '\0') ? opts->data_section : NULL;
+    format.alignment = opts->data_alignment;
+    format.elf_arch = opts->elf_arch;
+    format.asm_output = opts->asm_output;
+    format.if_changed = opts->if_changed;
+    return format;
+}
+
+// Grows *buffer to size bytes; its contents are not kept
+static uint8_t* grow_buffer(uint8_t** buffer, size_t* capacity, size_t size)
+{
+    if (size > *capacity) {
+        free(*buffer);
+        *buffer = (uint8_t*)malloc(size);
+        *capacity = *buffer ? size : 0;
     }
+    return *buffer;
+}
 
-    ImageData image = { 0 };
-    if (load_image(opts->infilename, &image) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
+static ThreadPool* worker_pool(ConvertWorker* worker)
+{
+    if (!worker->pool) {
+        worker->pool = thread_pool_create(worker->threads);
     }
+    return worker->pool;
+}
 
-    uint8_t gamma_lut[LUT_SIZE];
-    uint8_t contrast_brightness_lut[LUT_SIZE];
-    if (initialize_luts(opts->gamma, opts->contrast, opts->lightness, gamma_lut, contrast_brightness_lut) != EXIT_SUCCESS) {
-        free_image_memory(&image);
+void convert_worker_release(ConvertWorker* worker)
+{
+    if (!worker) return;
+    thread_pool_destroy(worker->pool);
+    free(worker->indices);
+    free(worker->rows);
+    memset(worker, 0, sizeof(ConvertWorker));
+}
+
+static void report_output(const ProgramOptions* opts, size_t bytes, double seconds)
+{
+    if (!opts->verbose) return;
+    const double megabytes = (double)bytes / (1024.0 * 1024.0);
+    printf("Wrote %zu bytes to %s in %.2f ms (%.1f MiB/s)\n", bytes, opts->outfilename, seconds * 1000.0,
+           seconds > 0.0 ? megabytes / seconds : 0.0);
+}
+
+// Writes the indexed image and reports the write when asked to
+static int write_output(const ProgramOptions* opts, const char* array_name, const ImageData* image, ThreadPool* pool)
+{
+    size_t bytes = 0;
+    const double start = wall_clock_seconds();
+    const OutputFormat format = output_format(opts);
+    if (write_image_data_to_file(opts->outfilename, array_name, image, &format, pool, &bytes) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
+    report_output(opts, bytes, wall_clock_seconds() - start);
+    return EXIT_SUCCESS;
+}
 
-    if (process_image_with_luts(&image, gamma_lut, contrast_brightness_lut) != EXIT_SUCCESS) {
-        free_image_memory(&image);
+// LUT pass, debug snapshot, then the selected dither kernel which leaves an indexed image
+static int process_staged(ImageData* image, const ToneLut* lut, const ProgramOptions* opts, ThreadPool* pool)
+{
+    if (process_image_with_luts(image, lut) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
 
-    if (write_debug_image("processed.bmp", &image, opts) != EXIT_SUCCESS) {
-        free_image_memory(&image);
+    if (write_debug_image("processed.bmp", image, opts) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
 
     DitherFunc dither_function = NULL;
     switch (opts->dither_method) {
-    case 0:  dither_function = floydSteinbergDither; break;
-    case 1:  dither_function = jarvisDither;         break;
-    case 2:  dither_function = atkinsonDither;       break;
-    case 3:  dither_function = bayer16x16Dither;     break;
-    default: dither_function = noDither;             break;
+    case DITHER_FLOYD_STEINBERG: dither_function = opts->channel_diffusion ? floydSteinbergChannelDither : floydSteinbergDither; break;
+    case DITHER_JARVIS:          dither_function = opts->channel_diffusion ? jarvisChannelDither : jarvisDither;                 break;
+    case DITHER_ATKINSON:        dither_function = opts->channel_diffusion ? atkinsonChannelDither : atkinsonDither;             break;
+    case DITHER_BAYER_16X16:     dither_function = bayer16x16Dither;     break;
+    case DITHER_BLUE_NOISE:      dither_function = blueNoiseDither;      break;
+    default:                     dither_function = noDither;             break;
     }
 
-    if (dither_function) {
-        if (dither_function(&image) != EXIT_SUCCESS) {
-            free_image_memory(&image);
+    return dither_function(image, pool);
+}
+
+/*
+ * One row is decoded, dithered and written before the next is read, so memory holds a few rows
+ * instead of the image. The output is the same as the whole-image path with the same options.
+ */
+static int process_streaming(const ProgramOptions* opts, const ToneLut* lut, const char* array_name, ConvertWorker* worker)
+{
+    ScanlineReader* reader = scanline_reader_open(opts->infilename);
+    if (!reader) {
+        return EXIT_FAILURE;
+    }
+
+    const int width = scanline_reader_width(reader);
+    const int height = scanline_reader_height(reader);
+    uint8_t* rgb = grow_buffer(&worker->rows, &worker->rows_capacity, (size_t)width * (RGB_COMPONENTS + 1));
+    uint8_t* indices = rgb ? rgb + (size_t)width * RGB_COMPONENTS : NULL;
+    DitherStream* stream = dither_stream_create(opts->dither_method, width, lut);
+    RowWriter writer;
+    double write_seconds = 0.0;
+    int result = EXIT_FAILURE;
+
+    if (!rgb || !indices) {
+        fileio_error("Failed to allocate row buffers.");
+        goto cleanup;
+    }
+    if (!stream) {
+        goto cleanup;
+    }
+    const OutputFormat format = output_format(opts);
+    if (row_writer_open(&writer, opts->outfilename, array_name, width, height, &format) != EXIT_SUCCESS) {
+        goto cleanup;
+    }
+
+    for (int y = 0; y < height; y++) {
+        if (scanline_reader_read_row(reader, rgb) != EXIT_SUCCESS) {
+            row_writer_discard(&writer);
+            goto cleanup;
+        }
+        dither_stream_row(stream, rgb, indices);
+        const double write_start = wall_clock_seconds();
+        if (row_writer_write(&writer, indices) != EXIT_SUCCESS) {
+            row_writer_discard(&writer);
+            goto cleanup;
+        }
+        write_seconds += wall_clock_seconds() - write_start;
+    }
+    const double finish_start = wall_clock_seconds();
+    result = row_writer_finish(&writer);
+    if (result == EXIT_SUCCESS) {
+        report_output(opts, writer.bytes_written, write_seconds + wall_clock_seconds() - finish_start);
+    }
+
+cleanup:
+    dither_stream_free(stream);
+    scanline_reader_close(reader);
+    return result;
+}
+
+/*
+ * Uncompressed inputs are not decoded at all: the kernels read rows straight from the mapped
+ * file (bottom-up BMP rows by a negative stride) and write indices to a buffer of their own.
+ */
+static int process_mapped(const ProgramOptions* opts, const ToneLut* lut, const char* array_name, MappedImage* mapped, ConvertWorker* worker)
+{
+    const PixelLayout* layout = mapped_image_layout(mapped);
+    ImageData indexed = { 0 };
+    indexed.width = layout->width;
+    indexed.height = layout->height;
+    indexed.format = PIXEL_FORMAT_INDEXED8;
+    indexed.data = grow_buffer(&worker->indices, &worker->indices_capacity, (size_t)layout->width * layout->height + 1);
+    if (!indexed.data) {
+        mapped_image_close(mapped);
+        return fileio_error("Failed to allocate image memory.");
+    }
+
+    ThreadPool* pool = worker_pool(worker);
+    int result = dither_pixel_layout(layout, indexed.data, pool, opts->dither_method, lut);
+    mapped_image_close(mapped);
+
+    if (result == EXIT_SUCCESS) {
+        result = write_output(opts, array_name, &indexed, pool);
+    }
+    return result;
+}
+
+int prepare_conversion(const ProgramOptions* opts, ToneLut* lut)
+{
+    if (initialize_luts(opts->gamma, opts->contrast, opts->lightness, opts->curves_filename, lut) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (initialize_channel_quantizer() != EXIT_SUCCESS) {
+        return fileio_error("Failed to initialize colour quantizer.");
+    }
+    return EXIT_SUCCESS;
+}
+
+static int convert_image(const ProgramOptions* opts, const ToneLut* lut, const char* array_name, ConvertWorker* worker)
+{
+    if (opts->stream_mode) {
+        return process_streaming(opts, lut, array_name, worker);
+    }
+
+    // Debug mode needs a decoded image to write its intermediate files from
+    if (!opts->debug_mode) {
+        MappedImage* mapped = mapped_image_open(opts->infilename, opts->raw_width, opts->raw_height);
+        if (mapped) {
+            return process_mapped(opts, lut, array_name, mapped, worker);
+        }
+        if (opts->raw_width > 0) {
             return EXIT_FAILURE;
         }
     }
 
-    char array_name[MAX_FILENAME_LENGTH];
-    if (trim_filename_copy(opts->outfilename, array_name, MAX_FILENAME_LENGTH) == NULL) {
-        free_image_memory(&image);
-        return fileio_error("trim_filename_copy failed");
+    ImageData image = { 0 };
+    if (load_image(opts->infilename, &image) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
     }
-    if (write_image_data_to_file(opts->outfilename, array_name, &image, opts->header_output, opts->bin_output) != EXIT_SUCCESS) {
+
+    // Debug mode needs the intermediate images, so it always takes the staged path
+    ThreadPool* pool = worker_pool(worker);
+    int result;
+    if (!opts->debug_mode && is_fused_dither_method(opts->dither_method)) {
+        result = fused_convert_image(&image, lut, opts->dither_method, pool);
+    }
+    else {
+        result = process_staged(&image, lut, opts, pool);
+    }
+    if (result == EXIT_SUCCESS) {
+        result = write_output(opts, array_name, &image, pool);
+    }
+    if (result != EXIT_SUCCESS) {
         free_image_memory(&image);
         return EXIT_FAILURE;
     }
@@ -140,4 +313,201 @@ int process_image(ProgramOptions* opts)
 
     free_image_memory(&image);
     return EXIT_SUCCESS;
+}
+
+static int output_array_name(const ProgramOptions* opts, char* array_name)
+{
+    if (opts->symbol_name[0] != '\0') {
+        strcpy(array_name, opts->symbol_name);
+        return EXIT_SUCCESS;
+    }
+    return symbol_from_filename(opts->outfilename, array_name, MAX_FILENAME_LENGTH);
+}
+
+// EXIT_FAILURE when the cache cannot be used at all; *restored tells a hit from a miss
+static int restore_from_cache(const ProgramOptions* opts, const char* array_name, OutputCache* cache, bool* restored)
+{
+    *restored = false;
+    const OutputFormat format = output_format(opts);
+    if (output_cache_open(cache, opts, array_name, &format) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    size_t bytes = 0;
+    const double start = wall_clock_seconds();
+    if (output_cache_restore(cache, &bytes) == EXIT_SUCCESS) {
+        *restored = true;
+        if (opts->verbose) {
+            printf("Restored %zu bytes to %s from the cache in %.2f ms\n", bytes, opts->outfilename, (wall_clock_seconds() - start) * 1000.0);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int convert_file(const ProgramOptions* opts, const ToneLut* lut, ConvertWorker* worker)
+{
+    char array_name[MAX_FILENAME_LENGTH];
+    if (output_array_name(opts, array_name) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // Debug mode is for looking at the intermediate images, which a cache hit would not write
+    if (opts->cache_directory[0] == '\0' || opts->debug_mode) {
+        return convert_image(opts, lut, array_name, worker);
+    }
+
+    OutputCache cache;
+    bool restored;
+    if (restore_from_cache(opts, array_name, &cache, &restored) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (restored) {
+        return EXIT_SUCCESS;
+    }
+
+    if (convert_image(opts, lut, array_name, worker) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    // The output is already written, so a cache that cannot take it only costs the next run
+    output_cache_store(&cache, opts->cache_size_mib);
+    return EXIT_SUCCESS;
+}
+
+struct StagedImage {
+    ProgramOptions opts;
+    char array_name[MAX_FILENAME_LENGTH];
+    OutputCache cache;
+    bool cache_miss;        // Store the output once it is written
+    MappedImage* mapped;    // Uncompressed input, dithered where it sits
+    ImageData image;        // Decoded input, then the indices
+    bool owns_image;        // image.data is a decoded image rather than the index buffer
+    uint8_t* indices;       // Index buffer for mapped inputs, kept for the next image
+    size_t indices_capacity;
+};
+
+StagedImage* staged_image_create(void)
+{
+    return (StagedImage*)calloc(1, sizeof(StagedImage));
+}
+
+// Drops the image in flight; the index buffer stays
+static void staged_image_reset(StagedImage* staged)
+{
+    mapped_image_close(staged->mapped);
+    staged->mapped = NULL;
+    if (staged->owns_image) {
+        free_image_memory(&staged->image);
+    }
+    memset(&staged->image, 0, sizeof(ImageData));
+    staged->owns_image = false;
+}
+
+void staged_image_free(StagedImage* staged)
+{
+    if (!staged) return;
+    staged_image_reset(staged);
+    free(staged->indices);
+    free(staged);
+}
+
+int stage_decode(StagedImage* staged, const ProgramOptions* opts, bool* pending)
+{
+    *pending = false;
+    staged->opts = *opts;
+    staged->cache_miss = false;
+    if (output_array_name(opts, staged->array_name) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (opts->cache_directory[0] != '\0') {
+        bool restored;
+        if (restore_from_cache(opts, staged->array_name, &staged->cache, &restored) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        if (restored) {
+            return EXIT_SUCCESS;
+        }
+        staged->cache_miss = true;
+    }
+
+    staged->mapped = mapped_image_open(opts->infilename, opts->raw_width, opts->raw_height);
+    if (staged->mapped) {
+        mapped_image_prefetch(staged->mapped);
+    }
+    else {
+        if (opts->raw_width > 0 || load_image(opts->infilename, &staged->image) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        staged->owns_image = true;
+    }
+    *pending = true;
+    return EXIT_SUCCESS;
+}
+
+int stage_process(StagedImage* staged, const ToneLut* lut)
+{
+    const ProgramOptions* opts = &staged->opts;
+    int result;
+
+    if (staged->mapped) {
+        const PixelLayout* layout = mapped_image_layout(staged->mapped);
+        ImageData indexed = { 0 };
+        indexed.width = layout->width;
+        indexed.height = layout->height;
+        indexed.format = PIXEL_FORMAT_INDEXED8;
+        indexed.data = grow_buffer(&staged->indices, &staged->indices_capacity, (size_t)layout->width * layout->height + 1);
+        result = indexed.data ? dither_pixel_layout(layout, indexed.data, NULL, opts->dither_method, lut)
+                              : fileio_error("Failed to allocate image memory.");
+        mapped_image_close(staged->mapped);
+        staged->mapped = NULL;
+        staged->image = indexed;
+    }
+    else if (is_fused_dither_method(opts->dither_method)) {
+        result = fused_convert_image(&staged->image, lut, opts->dither_method, NULL);
+    }
+    else {
+        result = process_staged(&staged->image, lut, opts, NULL);
+    }
+
+    if (result != EXIT_SUCCESS) {
+        staged_image_reset(staged);
+    }
+    return result;
+}
+
+int stage_write(StagedImage* staged)
+{
+    int result = write_output(&staged->opts, staged->array_name, &staged->image, NULL);
+    staged_image_reset(staged);
+    if (result == EXIT_SUCCESS && staged->cache_miss) {
+        // The output is already written, so a cache that cannot take it only costs the next run
+        output_cache_store(&staged->cache, staged->opts.cache_size_mib);
+    }
+    return result;
+}
+
+int process_image(ProgramOptions* opts)
+{
+    if (!opts) {
+        return fileio_error("Null pointer passed to process_image.");
+    }
+
+    if (opts->infilename[0] == '\0') {
+        return fileio_error("No input file specified.");
+    }
+
+    if (opts->outfilename[0] == '\0') {
+        return fileio_error("No output file specified.");
+    }
+
+    ToneLut lut;
+    if (prepare_conversion(opts, &lut) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    ConvertWorker worker = { 0 };
+    worker.threads = opts->threads;
+    const int result = convert_file(opts, &lut, &worker);
+    convert_worker_release(&worker);
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,391 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "error.h"
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE  4096
+#define INFLATE_MAX_BITS    15
+#define INFLATE_FAST_BITS   9
+#define INFLATE_MAX_LCODES  286
+#define INFLATE_MAX_DCODES  30
+
+/*
+ * Canonical Huffman decoding in the style of Mark Adler's puff: count[] holds the number of codes
+ * of each length and symbol[] the symbols in code order. Codes of up to INFLATE_FAST_BITS bits are
+ * also found with one lookup in fast[], which holds (length << 9) | symbol, or 0 for longer codes.
+ */
+typedef struct {
+    short count[INFLATE_MAX_BITS + 1];
+    short symbol[INFLATE_MAX_LCODES + 2];
+    uint16_t fast[1 << INFLATE_FAST_BITS];
+} Huffman;
+
+typedef enum {
+    INFLATE_HEADER = 0,
+    INFLATE_BLOCK_START,
+    INFLATE_STORED,
+    INFLATE_CODES,
+    INFLATE_DONE
+} InflateState;
+
+struct Inflater {
+    InflateReadFunc read;
+    void* context;
+    uint8_t input[INFLATE_INPUT_SIZE];
+    size_t input_pos;
+    size_t input_len;
+    uint32_t bit_buffer;
+    int bit_count;
+    InflateState state;
+    int last_block;
+    size_t stored_remaining;
+    int copy_length;        // Bytes of the current match still to copy
+    int copy_distance;
+    uint8_t window[INFLATE_WINDOW_SIZE];
+    size_t total_out;
+    int error;
+    Huffman lencode;
+    Huffman distcode;
+};
+
+static const short LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Next input byte, or -1 at the end of the input
+static int next_byte(Inflater* inf)
+{
+    if (inf->input_pos == inf->input_len) {
+        inf->input_len = inf->read(inf->context, inf->input, INFLATE_INPUT_SIZE);
+        inf->input_pos = 0;
+        if (inf->input_len == 0) return -1;
+    }
+    return inf->input[inf->input_pos++];
+}
+
+// Tops the bit buffer up to at least need bits; fewer are only left at the end of the input
+static void fill_bits(Inflater* inf, int need)
+{
+    while (inf->bit_count < need) {
+        int byte = next_byte(inf);
+        if (byte < 0) return;
+        inf->bit_buffer |= (uint32_t)byte << inf->bit_count;
+        inf->bit_count += 8;
+    }
+}
+
+static int get_bits(Inflater* inf, int need)
+{
+    fill_bits(inf, need);
+    if (inf->bit_count < need) {
+        inf->error = 1;
+        return 0;
+    }
+    int value = (int)(inf->bit_buffer & ((1u << need) - 1));
+    inf->bit_buffer >>= need;
+    inf->bit_count -= need;
+    return value;
+}
+
+// Returns 0 for a complete code set, >0 for an incomplete one, <0 for an over-subscribed one
+static int build_huffman(Huffman* h, const short* lengths, int n)
+{
+    short offs[INFLATE_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int symbol = 0; symbol < n; symbol++) {
+        h->count[lengths[symbol]]++;
+    }
+    if (h->count[0] == n) return 0;
+
+    int left = 1;
+    for (int len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < INFLATE_MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (int symbol = 0; symbol < n; symbol++) {
+        if (lengths[symbol] != 0) {
+            h->symbol[offs[lengths[symbol]]++] = (short)symbol;
+        }
+    }
+
+    // Codes are sent most significant bit first, so the lookup is indexed by the reversed code
+    int code = 0;
+    int index = 0;
+    for (int len = 1; len <= INFLATE_FAST_BITS; len++) {
+        for (int i = 0; i < h->count[len]; i++, code++, index++) {
+            int reversed = 0;
+            for (int b = 0; b < len; b++) {
+                reversed |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (int j = reversed; j < (1 << INFLATE_FAST_BITS); j += 1 << len) {
+                h->fast[j] = (uint16_t)((len << 9) | h->symbol[index]);
+            }
+        }
+        code <<= 1;
+    }
+    return left;
+}
+
+static int decode_symbol(Inflater* inf, const Huffman* h)
+{
+    fill_bits(inf, INFLATE_FAST_BITS);
+    const uint16_t entry = h->fast[inf->bit_buffer & ((1u << INFLATE_FAST_BITS) - 1)];
+    const int len = entry >> 9;
+    if (entry != 0 && len <= inf->bit_count) {
+        inf->bit_buffer >>= len;
+        inf->bit_count -= len;
+        return entry & 0x1FF;
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int bits = 1; bits <= INFLATE_MAX_BITS; bits++) {
+        code |= get_bits(inf, 1);
+        if (inf->error) return -1;
+        const int count = h->count[bits];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    inf->error = 1;
+    return -1;
+}
+
+static int build_fixed_tables(Inflater* inf)
+{
+    short lengths[288];
+    int symbol = 0;
+    for (; symbol < 144; symbol++) lengths[symbol] = 8;
+    for (; symbol < 256; symbol++) lengths[symbol] = 9;
+    for (; symbol < 280; symbol++) lengths[symbol] = 7;
+    for (; symbol < 288; symbol++) lengths[symbol] = 8;
+    build_huffman(&inf->lencode, lengths, 288);
+
+    for (symbol = 0; symbol < INFLATE_MAX_DCODES; symbol++) lengths[symbol] = 5;
+    build_huffman(&inf->distcode, lengths, INFLATE_MAX_DCODES);
+    return EXIT_SUCCESS;
+}
+
+static int build_dynamic_tables(Inflater* inf)
+{
+    static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    short lengths[INFLATE_MAX_LCODES + INFLATE_MAX_DCODES];
+
+    const int nlen = get_bits(inf, 5) + 257;
+    const int ndist = get_bits(inf, 5) + 1;
+    const int ncode = get_bits(inf, 4) + 4;
+    if (inf->error || nlen > INFLATE_MAX_LCODES || ndist > INFLATE_MAX_DCODES) return EXIT_FAILURE;
+
+    int index;
+    for (index = 0; index < ncode; index++) lengths[order[index]] = (short)get_bits(inf, 3);
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (inf->error || build_huffman(&inf->lencode, lengths, 19) != 0) return EXIT_FAILURE;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol = decode_symbol(inf, &inf->lencode);
+        if (symbol < 0) return EXIT_FAILURE;
+        if (symbol < 16) {
+            lengths[index++] = (short)symbol;
+            continue;
+        }
+
+        short len = 0;
+        if (symbol == 16) {
+            if (index == 0) return EXIT_FAILURE;
+            len = lengths[index - 1];
+            symbol = 3 + get_bits(inf, 2);
+        }
+        else if (symbol == 17) {
+            symbol = 3 + get_bits(inf, 3);
+        }
+        else {
+            symbol = 11 + get_bits(inf, 7);
+        }
+        if (inf->error || index + symbol > nlen + ndist) return EXIT_FAILURE;
+        while (symbol--) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) return EXIT_FAILURE;
+
+    // Incomplete codes are only allowed for a single length or distance code
+    int err = build_huffman(&inf->lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - inf->lencode.count[0] != 1)) return EXIT_FAILURE;
+    err = build_huffman(&inf->distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - inf->distcode.count[0] != 1)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+Inflater* inflater_create(InflateReadFunc read, void* context)
+{
+    if (!read) return NULL;
+
+    Inflater* inf = (Inflater*)calloc(1, sizeof(Inflater));
+    if (!inf) return NULL;
+    inf->read = read;
+    inf->context = context;
+    inf->state = INFLATE_HEADER;
+    return inf;
+}
+
+void inflater_free(Inflater* inflater)
+{
+    free(inflater);
+}
+
+static void emit(Inflater* inf, uint8_t value, uint8_t* out, size_t* produced)
+{
+    inf->window[inf->total_out++ & (INFLATE_WINDOW_SIZE - 1)] = value;
+    out[(*produced)++] = value;
+}
+
+static int start_block(Inflater* inf)
+{
+    if (inf->last_block) {
+        inf->state = INFLATE_DONE;
+        return EXIT_SUCCESS;
+    }
+    inf->last_block = get_bits(inf, 1);
+    const int type = get_bits(inf, 2);
+    if (inf->error) return EXIT_FAILURE;
+
+    if (type == 0) {
+        // Stored blocks start on a byte boundary
+        inf->bit_buffer >>= inf->bit_count & 7;
+        inf->bit_count -= inf->bit_count & 7;
+        const int len = get_bits(inf, 16);
+        const int nlen = get_bits(inf, 16);
+        if (inf->error || len != (~nlen & 0xFFFF)) return EXIT_FAILURE;
+        inf->stored_remaining = (size_t)len;
+        inf->state = INFLATE_STORED;
+        return EXIT_SUCCESS;
+    }
+    if (type == 1) {
+        build_fixed_tables(inf);
+    }
+    else if (type != 2 || build_dynamic_tables(inf) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    inf->state = INFLATE_CODES;
+    return EXIT_SUCCESS;
+}
+
+int inflater_read(Inflater* inf, uint8_t* out, size_t size)
+{
+    size_t produced = 0;
+
+    if (!inf || !out) {
+        return fileio_error("Null pointer passed to inflater_read.");
+    }
+
+    while (produced < size && !inf->error) {
+        if (inf->copy_length > 0) {
+            while (inf->copy_length > 0 && produced < size) {
+                emit(inf, inf->window[(inf->total_out - inf->copy_distance) & (INFLATE_WINDOW_SIZE - 1)], out, &produced);
+                inf->copy_length--;
+            }
+            continue;
+        }
+
+        switch (inf->state) {
+        case INFLATE_HEADER: {
+            const int cmf = get_bits(inf, 8);
+            const int flg = get_bits(inf, 8);
+            if (inf->error || (cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) {
+                inf->error = 1;
+                break;
+            }
+            inf->state = INFLATE_BLOCK_START;
+            break;
+        }
+        case INFLATE_BLOCK_START:
+            if (start_block(inf) != EXIT_SUCCESS) inf->error = 1;
+            break;
+
+        case INFLATE_STORED:
+            while (inf->stored_remaining > 0 && produced < size) {
+                // Whole bytes may still sit in the bit buffer after the block header
+                const int byte = (inf->bit_count >= 8) ? get_bits(inf, 8) : next_byte(inf);
+                if (byte < 0) {
+                    inf->error = 1;
+                    break;
+                }
+                emit(inf, (uint8_t)byte, out, &produced);
+                inf->stored_remaining--;
+            }
+            if (inf->stored_remaining == 0) inf->state = INFLATE_BLOCK_START;
+            break;
+
+        case INFLATE_CODES: {
+            int symbol = decode_symbol(inf, &inf->lencode);
+            if (symbol < 0) break;
+            if (symbol < 256) {
+                emit(inf, (uint8_t)symbol, out, &produced);
+                break;
+            }
+            if (symbol == 256) {
+                inf->state = INFLATE_BLOCK_START;
+                break;
+            }
+
+            symbol -= 257;
+            if (symbol >= 29) {
+                inf->error = 1;
+                break;
+            }
+            const int length = LENGTH_BASE[symbol] + get_bits(inf, LENGTH_EXTRA[symbol]);
+            const int dist_symbol = decode_symbol(inf, &inf->distcode);
+            if (dist_symbol < 0 || dist_symbol >= 30) {
+                inf->error = 1;
+                break;
+            }
+            const int distance = DIST_BASE[dist_symbol] + get_bits(inf, DIST_EXTRA[dist_symbol]);
+            if (inf->error || (size_t)distance > inf->total_out) {
+                inf->error = 1;
+                break;
+            }
+            inf->copy_length = length;
+            inf->copy_distance = distance;
+            break;
+        }
+        case INFLATE_DONE:
+            return fileio_error("Compressed data ended early.");
+        }
+    }
+
+    if (inf->error) {
+        return fileio_error("Corrupt compressed data.");
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
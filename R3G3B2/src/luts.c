@@ -8,46 +8,150 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <ctype.h>
 #include <math.h>
 
 #include "constrains.h"
 #include "luts.h"
 #include "error.h"
 
-int initialize_luts(float gamma, float contrast, float brightness, uint8_t* gamma_lut, uint8_t* contrast_brightness_lut)
+void tone_lut_identity(ToneLut* lut)
 {
-    if (!gamma_lut || !contrast_brightness_lut) {
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        for (int i = 0; i < LUT_SIZE; i++) {
+            lut->channel[c][i] = (uint8_t)i;
+        }
+    }
+}
+
+void tone_lut_compose(ToneLut* lut, const ToneLut* next)
+{
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        for (int i = 0; i < LUT_SIZE; i++) {
+            lut->channel[c][i] = next->channel[c][lut->channel[c][i]];
+        }
+    }
+}
+
+/*
+ * A curves file holds 256 values (one curve for all channels) or 768 (red, green, then blue),
+ * each 0-255, separated by whitespace or commas. Everything after a '#' on a line is ignored.
+ */
+int load_curves_file(const char* filename, ToneLut* curves)
+{
+    if (!filename || !curves) {
+        return fileio_error("Null pointer passed to load_curves_file.");
+    }
+
+    FILE* fp = fopen(filename, "r");
+    if (!fp) {
+        return fileio_perror("Failed to open curves file");
+    }
+
+    uint8_t values[RGB_COMPONENTS * LUT_SIZE];
+    int count = 0;
+    int ch;
+    while ((ch = fgetc(fp)) != EOF) {
+        if (ch == '#') {
+            while ((ch = fgetc(fp)) != EOF && ch != '\n');
+            continue;
+        }
+        if (isspace(ch) || ch == ',') {
+            continue;
+        }
+        if (!isdigit(ch)) {
+            fclose(fp);
+            return fileio_error("Curves file may only contain numbers from 0 to 255.");
+        }
+
+        int value = 0;
+        while (ch != EOF && isdigit(ch)) {
+            value = value * 10 + (ch - '0');
+            if (value > MAX_COLOUR_VALUE) {
+                fclose(fp);
+                return fileio_error("Curves file may only contain numbers from 0 to 255.");
+            }
+            ch = fgetc(fp);
+        }
+        if (ch != EOF) {
+            ungetc(ch, fp);
+        }
+        if (count == RGB_COMPONENTS * LUT_SIZE) {
+            fclose(fp);
+            return fileio_error("Curves file must hold 256 or 768 values.");
+        }
+        values[count++] = (uint8_t)value;
+    }
+    fclose(fp);
+
+    if (count != LUT_SIZE && count != RGB_COMPONENTS * LUT_SIZE) {
+        return fileio_error("Curves file must hold 256 or 768 values.");
+    }
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        const uint8_t* curve = (count == LUT_SIZE) ? values : values + c * LUT_SIZE;
+        for (int i = 0; i < LUT_SIZE; i++) {
+            curves->channel[c][i] = curve[i];
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int initialize_luts(float gamma, float contrast, float brightness, const char* curves_filename, ToneLut* lut)
+{
+    if (!lut) {
         fileio_error("Null pointer passed to LUT initialization.");
         return EXIT_FAILURE;
     }
 
     float factor = (259.0f * (contrast + 255.0f)) / (255.0f * (259.0f - contrast));
 
+    // Each stage only does its own adjustment; composing them applies gamma exactly once
+    ToneLut contrast_brightness;
     for (int i = 0; i < LUT_SIZE; i++) {
         float value = (float)i / (float)MAX_COLOUR_VALUE;                                                           // Normalize the input to the 0-1 range
-        value = powf(value, 1.0f / gamma);                                                                          // Apply gamma correction
         value = factor * (value * brightness - 0.5f) + 0.5f;                                                        // Apply contrast and brightness adjustments
         value = fmaxf(0.0f, fminf(value, 1.0f));                                                                    // Clamp the value to ensure it stays within 0-1
-        contrast_brightness_lut[i] = (uint8_t)(value * (float)MAX_COLOUR_VALUE);                                    // Scale the result back to 0-255 and store in the contrast/brightness LUT
-        gamma_lut[i] = (uint8_t)(powf((float)i / (float)MAX_COLOUR_VALUE, 1.0f / gamma) * (float)MAX_COLOUR_VALUE); // Apply gamma correction and store in the gamma LUT
+        const uint8_t adjusted = (uint8_t)(value * (float)MAX_COLOUR_VALUE);                                        // Scale the result back to 0-255
+        const uint8_t corrected = (uint8_t)(powf((float)i / (float)MAX_COLOUR_VALUE, 1.0f / gamma) * (float)MAX_COLOUR_VALUE); // Apply gamma correction
+
+        for (int c = 0; c < RGB_COMPONENTS; c++) {
+            contrast_brightness.channel[c][i] = adjusted;
+            lut->channel[c][i] = corrected;
+        }
+    }
+    tone_lut_compose(lut, &contrast_brightness);
+
+    if (curves_filename && curves_filename[0] != '\0') {
+        ToneLut curves;
+        if (load_curves_file(curves_filename, &curves) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        tone_lut_compose(lut, &curves);
     }
     return EXIT_SUCCESS;
 }
 
-int process_image_with_luts(ImageData* image, const uint8_t* gamma_lut, const uint8_t* contrast_brightness_lut)
+int process_image_with_luts(ImageData* image, const ToneLut* lut)
 {
-    if (!image || !image->data || !gamma_lut || !contrast_brightness_lut) {
+    if (!image || !image->data || !lut) {
         fileio_error("Null pointer passed to process_image_with_luts.");
         return EXIT_FAILURE;
     }
+    if (image->format != PIXEL_FORMAT_RGB888) {
+        return fileio_error("process_image_with_luts needs an RGB image.");
+    }
 
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            int idx = (y * image->width + x) * RGB_COMPONENTS;
-            image->data[idx] = contrast_brightness_lut[gamma_lut[image->data[idx]]];     // Red channel
-            image->data[idx + 1] = contrast_brightness_lut[gamma_lut[image->data[idx + 1]]]; // Green channel
-            image->data[idx + 2] = contrast_brightness_lut[gamma_lut[image->data[idx + 2]]]; // Blue channel
-        }
+    const uint8_t* red = lut->channel[0];
+    const uint8_t* green = lut->channel[1];
+    const uint8_t* blue = lut->channel[2];
+    uint8_t* pixel = image->data;
+    const size_t pixel_count = (size_t)image->width * image->height;
+
+    // One read and one write per byte
+    for (size_t i = 0; i < pixel_count; i++, pixel += RGB_COMPONENTS) {
+        pixel[0] = red[pixel[0]];
+        pixel[1] = green[pixel[1]];
+        pixel[2] = blue[pixel[2]];
     }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
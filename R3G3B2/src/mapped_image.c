@@ -0,0 +1,280 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "constrains.h"
+#include "mapped_image.h"
+#include "fileio.h"
+#include "error.h"
+
+// The smallest page size in use, so every page of the mapping is touched
+#define PREFETCH_STRIDE 4096
+
+struct MappedImage {
+    const uint8_t* data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    PixelLayout layout;
+};
+
+static bool map_file(MappedImage* image, const char* filename)
+{
+#if defined(_WIN32)
+    image->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (image->file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(image->file, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1) return false;
+    image->size = (size_t)size.QuadPart;
+
+    image->mapping = CreateFileMappingA(image->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!image->mapping) return false;
+    image->data = (const uint8_t*)MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0);
+    return image->data != NULL;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || (unsigned long long)st.st_size > (size_t)-1) {
+        close(fd);
+        return false;
+    }
+    image->size = (size_t)st.st_size;
+
+    void* data = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (data == MAP_FAILED) return false;
+
+    // Rows are read in order, mostly once; let the kernel read ahead
+    posix_madvise(data, image->size, POSIX_MADV_SEQUENTIAL);
+    image->data = (const uint8_t*)data;
+    return true;
+#endif
+}
+
+static void unmap_file(MappedImage* image)
+{
+#if defined(_WIN32)
+    if (image->data) UnmapViewOfFile(image->data);
+    if (image->mapping) CloseHandle(image->mapping);
+    if (image->file && image->file != INVALID_HANDLE_VALUE) CloseHandle(image->file);
+#else
+    if (image->data) munmap((void*)image->data, image->size);
+#endif
+    image->data = NULL;
+}
+
+// True when row_count rows, stride bytes apart with row_bytes used of each, fit after offset
+static bool rows_fit(const MappedImage* image, size_t offset, size_t row_bytes, size_t stride, int row_count)
+{
+    if (offset > image->size || image->size - offset < row_bytes) return false;
+    return (size_t)(row_count - 1) <= (image->size - offset - row_bytes) / stride;
+}
+
+// BITMAPINFOHEADER and later, BI_RGB or the default BI_BITFIELDS masks, 24 or 32 bits per pixel
+static bool layout_bmp(MappedImage* image)
+{
+    const uint8_t* p = image->data;
+    if (image->size < 54) return false;
+
+    const uint32_t offset = get_u32le(p + 10);
+    const uint32_t hsz = get_u32le(p + 14);
+    if (hsz != 40 && hsz != 56 && hsz != 108 && hsz != 124) return false;
+
+    const int32_t width = (int32_t)get_u32le(p + 18);
+    const int32_t height = (int32_t)get_u32le(p + 22);
+    const int bpp = p[28] | (p[29] << 8);
+    const uint32_t compression = get_u32le(p + 30);
+
+    if (bpp != 24 && bpp != 32) return false;
+    if (compression == 3) {
+        // Masks follow a 40-byte header, and sit inside the larger ones
+        if (bpp != 32 || hsz == 56 || image->size < 14 + 40 + 12) return false;
+        if (get_u32le(p + 54) != 0x00FF0000 || get_u32le(p + 58) != 0x0000FF00 || get_u32le(p + 62) != 0x000000FF) return false;
+    }
+    else if (compression != 0) {
+        return false;
+    }
+    if (width <= 0 || height == 0 || height == INT32_MIN) return false;
+
+    const int rows = (height < 0) ? -height : height;
+    const size_t stride = (((size_t)width * bpp + 31) / 32) * 4;
+    if (!rows_fit(image, offset, (size_t)width * (bpp / 8), stride, rows)) return false;
+
+    PixelLayout* layout = &image->layout;
+    layout->width = width;
+    layout->height = rows;
+    layout->pixel_size = bpp / 8;
+    layout->order = PIXEL_ORDER_BGR;
+    if (height > 0) {
+        // Bottom-up: the top row is the last one stored
+        layout->top_row = p + offset + (size_t)(rows - 1) * stride;
+        layout->row_stride = -(ptrdiff_t)stride;
+    }
+    else {
+        layout->top_row = p + offset;
+        layout->row_stride = (ptrdiff_t)stride;
+    }
+    return true;
+}
+
+// Parses one header number, skipping whitespace and comments; false past the end or on junk
+static bool pnm_number(const MappedImage* image, size_t* pos, int* value)
+{
+    const uint8_t* p = image->data;
+    for (;;) {
+        while (*pos < image->size && isspace(p[*pos])) (*pos)++;
+        if (*pos < image->size && p[*pos] == '#') {
+            while (*pos < image->size && p[*pos] != '\n' && p[*pos] != '\r') (*pos)++;
+            continue;
+        }
+        break;
+    }
+
+    long result = 0;
+    const size_t start = *pos;
+    while (*pos < image->size && isdigit(p[*pos])) {
+        result = result * 10 + (p[*pos] - '0');
+        if (result > 0x7FFFFFFF) return false;
+        (*pos)++;
+    }
+    *value = (int)result;
+    return *pos > start;
+}
+
+// P6 and P5 with samples of one byte, read as the bytes they are like stb_image does
+static bool layout_pnm(MappedImage* image)
+{
+    const uint8_t* p = image->data;
+    size_t pos = 2;
+    int width, height, maxval;
+
+    if (!pnm_number(image, &pos, &width) || !pnm_number(image, &pos, &height) || !pnm_number(image, &pos, &maxval)) return false;
+    if (width <= 0 || height <= 0 || maxval <= 0 || maxval > 255) return false;
+    pos++; // The single whitespace character after maxval
+
+    const int channels = (p[1] == '6') ? RGB_COMPONENTS : 1;
+    const size_t stride = (size_t)width * channels;
+    if (!rows_fit(image, pos, stride, stride, height)) return false;
+
+    PixelLayout* layout = &image->layout;
+    layout->width = width;
+    layout->height = height;
+    layout->pixel_size = channels;
+    layout->order = (channels == 1) ? PIXEL_ORDER_GRAY : PIXEL_ORDER_RGB;
+    layout->top_row = p + pos;
+    layout->row_stride = (ptrdiff_t)stride;
+    return true;
+}
+
+static bool layout_raw(MappedImage* image, int width, int height)
+{
+    const size_t stride = (size_t)width * RGB_COMPONENTS;
+    if (!rows_fit(image, 0, stride, stride, height)) {
+        fprintf(stderr, "Error: Raw input is smaller than %d x %d RGB888 pixels.\n", width, height);
+        return false;
+    }
+
+    PixelLayout* layout = &image->layout;
+    layout->width = width;
+    layout->height = height;
+    layout->pixel_size = RGB_COMPONENTS;
+    layout->order = PIXEL_ORDER_RGB;
+    layout->top_row = image->data;
+    layout->row_stride = (ptrdiff_t)stride;
+    return true;
+}
+
+MappedImage* mapped_image_open(const char* filename, int raw_width, int raw_height)
+{
+    const bool raw = raw_width > 0 && raw_height > 0;
+    if (!filename) {
+        fileio_error("Null pointer passed to mapped_image_open.");
+        return NULL;
+    }
+
+    MappedImage* image = (MappedImage*)calloc(1, sizeof(MappedImage));
+    if (!image) {
+        fileio_error("Failed to allocate mapped image.");
+        return NULL;
+    }
+
+    bool mapped = map_file(image, filename);
+    if (!mapped && raw) {
+        fileio_perror("Failed to map input file");
+    }
+
+    if (mapped) {
+        const uint8_t* p = image->data;
+        if (raw) {
+            mapped = layout_raw(image, raw_width, raw_height);
+        }
+        else if (image->size >= 2 && p[0] == 'B' && p[1] == 'M') {
+            mapped = layout_bmp(image);
+        }
+        else if (image->size >= 2 && p[0] == 'P' && (p[1] == '5' || p[1] == '6')) {
+            mapped = layout_pnm(image);
+        }
+        else {
+            mapped = false;
+        }
+    }
+
+    if (!mapped) {
+        mapped_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+void mapped_image_close(MappedImage* image)
+{
+    if (!image) return;
+    unmap_file(image);
+    free(image);
+}
+
+const PixelLayout* mapped_image_layout(const MappedImage* image)
+{
+    return image ? &image->layout : NULL;
+}
+
+void mapped_image_prefetch(const MappedImage* image)
+{
+    if (!image) return;
+
+    // One read per page is enough; the sum only keeps the reads from being optimized away
+    volatile uint8_t sink = 0;
+    for (size_t offset = 0; offset < image->size; offset += PREFETCH_STRIDE) {
+        sink ^= image->data[offset];
+    }
+    (void)sink;
+}
\ No newline at end of file
@@ -8,8 +8,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 #include "options.h"
+#include "elf_object.h"
+#include "output_cache.h"
+#include "batch.h"
 #include "error.h"
 
 void init_program_options(ProgramOptions* opts)
@@ -23,6 +27,9 @@ void init_program_options(ProgramOptions* opts)
     opts->debug_mode = false;
     opts->header_output = false;
     opts->debug_filename[0] = '\0';
+    opts->threads = 0;
+    opts->cache_size_mib = OUTPUT_CACHE_DEFAULT_MIB;
+    opts->queue_depth = BATCH_DEFAULT_QUEUE_DEPTH;
 }
 
 int parse_command_line_args(int argc, char* argv[], ProgramOptions* opts)
@@ -102,6 +109,189 @@ int parse_command_line_args(int argc, char* argv[], ProgramOptions* opts)
             }
             opts->header_output = true;
         }
+        else if (strcmp(argv[i], "-encoding") == 0) {
+            if (i + 1 < argc) {
+                const char* name = argv[i + 1];
+                if (strcmp(name, "bytes") == 0)       opts->header_encoding = HEADER_ENCODING_BYTES;
+                else if (strcmp(name, "string") == 0) opts->header_encoding = HEADER_ENCODING_STRING;
+                else if (strcmp(name, "words") == 0)  opts->header_encoding = HEADER_ENCODING_WORDS;
+                else if (strcmp(name, "embed") == 0)  opts->header_encoding = HEADER_ENCODING_EMBED;
+                else return fileio_error("-encoding must be bytes, string, words or embed.");
+                i++;
+            }
+            else {
+                return fileio_error("-encoding option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-elf") == 0) {
+            if (i + 1 < argc) {
+                opts->elf_arch = elf_arch_from_name(argv[i + 1]);
+                if (opts->elf_arch == ELF_ARCH_NONE) {
+                    return fileio_error("-elf must be x86, x86_64, arm, aarch64, riscv32 or riscv64.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-elf option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-asm") == 0) {
+            opts->asm_output = true;
+        }
+        else if (strcmp(argv[i], "-symbol") == 0) {
+            if (i + 1 < argc) {
+                const char* name = argv[i + 1];
+                bool valid = isalpha((unsigned char)name[0]) || name[0] == '_';
+                for (const char* c = name; valid && *c; c++) {
+                    valid = isalnum((unsigned char)*c) || *c == '_';
+                }
+                if (!valid) {
+                    return fileio_error("-symbol needs a C identifier.");
+                }
+                strncpy(opts->symbol_name, name, MAX_FILENAME_LENGTH - 1);
+                opts->symbol_name[MAX_FILENAME_LENGTH - 1] = '\0';
+                i++;
+            }
+            else {
+                return fileio_error("-symbol option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-split") == 0) {
+            opts->split_source = true;
+        }
+        else if (strcmp(argv[i], "-section") == 0) {
+            if (i + 1 < argc) {
+                // The name is written into a string literal, so it must not need escaping
+                if (argv[i + 1][0] == '\0' || strpbrk(argv[i + 1], "\"\\\n") != NULL) {
+                    return fileio_error("-section needs a section name without quotes or backslashes.");
+                }
+                strncpy(opts->data_section, argv[i + 1], MAX_FILENAME_LENGTH - 1);
+                opts->data_section[MAX_FILENAME_LENGTH - 1] = '\0';
+                i++;
+            }
+            else {
+                return fileio_error("-section option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-align") == 0) {
+            if (i + 1 < argc) {
+                opts->data_alignment = atoi(argv[i + 1]);
+                if (opts->data_alignment <= 0 || (opts->data_alignment & (opts->data_alignment - 1)) != 0) {
+                    return fileio_error("-align must be a power of two.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-align option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-threads") == 0) {
+            if (i + 1 < argc) {
+                opts->threads = atoi(argv[i + 1]);
+                if (opts->threads < 0) {
+                    return fileio_error("-threads must be 0 (one per CPU) or more.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-threads option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-curves") == 0) {
+            if (i + 1 < argc) {
+                strncpy(opts->curves_filename, argv[i + 1], MAX_FILENAME_LENGTH - 1);
+                opts->curves_filename[MAX_FILENAME_LENGTH - 1] = '\0';
+                i++;
+            }
+            else {
+                return fileio_error("-curves option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-channels") == 0) {
+            opts->channel_diffusion = true;
+        }
+        else if (strcmp(argv[i], "-raw") == 0) {
+            if (i + 1 < argc) {
+                if (sscanf(argv[i + 1], "%dx%d", &opts->raw_width, &opts->raw_height) != 2 || opts->raw_width <= 0 || opts->raw_height <= 0) {
+                    return fileio_error("-raw needs a size as <width>x<height>, e.g. 640x480.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-raw option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-verbose") == 0) {
+            opts->verbose = true;
+        }
+        else if (strcmp(argv[i], "-stream") == 0) {
+            opts->stream_mode = true;
+        }
+        else if (strcmp(argv[i], "-cache") == 0) {
+            if (i + 1 < argc) {
+                strncpy(opts->cache_directory, argv[i + 1], MAX_FILENAME_LENGTH - 1);
+                opts->cache_directory[MAX_FILENAME_LENGTH - 1] = '\0';
+                i++;
+            }
+            else {
+                return fileio_error("-cache option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-cache-size") == 0) {
+            if (i + 1 < argc) {
+                opts->cache_size_mib = atol(argv[i + 1]);
+                if (opts->cache_size_mib <= 0) {
+                    return fileio_error("-cache-size must be a size in MiB of at least 1.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-cache-size option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-cache-stats") == 0) {
+            opts->cache_stats = true;
+        }
+        else if (strcmp(argv[i], "-if-changed") == 0) {
+            opts->if_changed = true;
+        }
+        else if (strcmp(argv[i], "-batch") == 0) {
+            if (i + 1 < argc) {
+                strncpy(opts->batch_source, argv[i + 1], MAX_FILENAME_LENGTH - 1);
+                opts->batch_source[MAX_FILENAME_LENGTH - 1] = '\0';
+                i++;
+            }
+            else {
+                return fileio_error("-batch option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-pipeline") == 0) {
+            if (i + 1 < argc) {
+                int* threads = opts->pipeline_threads;
+                if (sscanf(argv[i + 1], "%d,%d,%d", &threads[0], &threads[1], &threads[2]) != 3 || threads[0] <= 0 || threads[1] <= 0 || threads[2] <= 0) {
+                    return fileio_error("-pipeline needs three thread counts as <decode>,<process>,<write>, e.g. 2,4,1.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-pipeline option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-queue") == 0) {
+            if (i + 1 < argc) {
+                opts->queue_depth = atoi(argv[i + 1]);
+                if (opts->queue_depth <= 0) {
+                    return fileio_error("-queue must be at least 1.");
+                }
+                i++;
+            }
+            else {
+                return fileio_error("-queue option requires an argument.");
+            }
+        }
+        else if (strcmp(argv[i], "-selftest") == 0) {
+            opts->self_test = true;
+        }
         else if (strcmp(argv[i], "-l") == 0) {
             if (i + 1 < argc) {
                 opts->lightness = (float)atof(argv[i + 1]);
@@ -115,13 +305,34 @@ int parse_command_line_args(int argc, char* argv[], ProgramOptions* opts)
             printf("Usage: R3G3B2 -i <input file> -o <output file> [-dm <method>] [-g <gamma>] [-c <contrast>] [-l <lightness>] [-h] [-b]\n");
             printf("  -i <input file>           : Specify input file\n");
             printf("  -o <output file>          : Specify output file\n");
-            printf("  -dm <method>              : Set dithering method (0: Floyd-Steinberg, 1: Jarvis, 2: Atkinson, 3: Bayer 16x16)\n");
+            printf("  -dm <method>              : Set dithering method (0: Floyd-Steinberg, 1: Jarvis, 2: Atkinson, 3: Bayer 16x16, 4: Blue noise 64x64)\n");
             printf("  -debug <debug_filename>   : Enable debug mode and specify debug file prefix\n");
             printf("  -g <gamma>                : Set gamma value (default: 1.0)\n");
             printf("  -c <contrast>             : Set contrast value (default: 0.0)\n");
             printf("  -l <lightness>            : Set lightness value (default: 1.0)\n");
+            printf("  -curves <file>            : Apply tone curves from a file (256 values, or 768 for R, G, B)\n");
             printf("  -h                        : Output a C header file\n");
             printf("  -b                        : Output a raw binary file\n");
+            printf("  -encoding <name>          : Header array encoding: bytes (default), string, words or embed (C23)\n");
+            printf("  -elf <arch>               : Output a relocatable ELF object: x86, x86_64, arm, aarch64, riscv32 or riscv64\n");
+            printf("  -asm                      : Output a GNU assembler .S file that .incbin's the pixels\n");
+            printf("  -symbol <name>            : Prefix of the generated symbols (default: the output file name)\n");
+            printf("  -split                    : With -h, write the pixels once to a .c file; the header keeps extern declarations\n");
+            printf("  -section <name>           : Place the pixel array in this linker section (-h, -elf and -asm)\n");
+            printf("  -align <bytes>            : Align the pixel array to this power of two (-h, -elf and -asm)\n");
+            printf("  -threads <count>          : Worker threads for conversion (default: 0, one per CPU)\n");
+            printf("  -channels                 : Error diffuse R, G and B as independent planes (same output)\n");
+            printf("  -raw <width>x<height>     : Input is headerless RGB888 of this size, read from a memory mapping\n");
+            printf("  -stream                   : Decode, dither and write one row at a time (memory for a few rows)\n");
+            printf("  -v, -verbose              : Report the bytes written and the write throughput\n");
+            printf("  -cache <dir>              : Reuse the output of an identical earlier conversion from this directory\n");
+            printf("  -cache-size <MiB>         : Trim the cache to this size, least recently used first (default: %d)\n", OUTPUT_CACHE_DEFAULT_MIB);
+            printf("  -cache-stats              : Print the hit rate and size of the -cache directory and exit\n");
+            printf("  -if-changed               : Leave an output untouched when its bytes would not change (keeps its timestamp)\n");
+            printf("  -batch <dir|glob|list>    : Convert every input of a directory, wildcard or list file into the -o directory\n");
+            printf("  -pipeline <d>,<p>,<w>     : Run a batch as decode, process and write stages with this many threads each\n");
+            printf("  -queue <images>           : Images waiting between two -pipeline stages (default: %d)\n", BATCH_DEFAULT_QUEUE_DEPTH);
+            printf("  -selftest                 : Check the quantizer, the parallel and the SSSE3 dithers against their references and exit\n");
             printf("  -help, -?, --help         : Display this help message\n");
             printf("Example: R3G3B2 -i tst.png -h -o tst.h -dm 0 -g 1.0 -c 0.0 -l 1.0\n");
             printf("Example: R3G3B2 -i tst.png -b -o tst.bin -dm 0 -g 1.0 -c 0.0 -l 1.0\n");
@@ -132,5 +343,42 @@ int parse_command_line_args(int argc, char* argv[], ProgramOptions* opts)
             return EXIT_FAILURE;
         }
     }
+    if (opts->stream_mode && opts->debug_mode) {
+        return fileio_error("-stream cannot be combined with -debug, which needs whole intermediate images.");
+    }
+    if (opts->stream_mode && opts->header_encoding != HEADER_ENCODING_BYTES) {
+        return fileio_error("-stream only writes the bytes header encoding.");
+    }
+    if (opts->cache_stats && opts->cache_directory[0] == '\0') {
+        return fileio_error("-cache-stats needs the -cache directory.");
+    }
+    const int output_modes = opts->header_output + opts->bin_output + (opts->elf_arch != ELF_ARCH_NONE) + opts->asm_output;
+    if (output_modes > 1) {
+        return fileio_error("Choose only one of -h, -b, -elf and -asm.");
+    }
+    if (opts->split_source && !opts->header_output) {
+        return fileio_error("-split only applies to -h output.");
+    }
+    if ((opts->data_section[0] != '\0' || opts->data_alignment > 0) && !opts->header_output && !opts->asm_output && opts->elf_arch == ELF_ARCH_NONE) {
+        return fileio_error("-section and -align only apply to -h, -elf and -asm output.");
+    }
+    if (opts->stream_mode && (opts->asm_output || opts->elf_arch != ELF_ARCH_NONE)) {
+        return fileio_error("-stream only writes -b and -h output.");
+    }
+    if (opts->raw_width > 0 && (opts->stream_mode || opts->debug_mode)) {
+        return fileio_error("-raw input is only read through a memory mapping, which -stream and -debug do not use.");
+    }
+    if (opts->batch_source[0] != '\0' && opts->infilename[0] != '\0') {
+        return fileio_error("-batch takes its inputs from the directory, wildcard or list; drop -i.");
+    }
+    if (opts->pipeline_threads[0] > 0 && opts->batch_source[0] == '\0') {
+        return fileio_error("-pipeline only applies to -batch.");
+    }
+    if (opts->pipeline_threads[0] > 0 && opts->stream_mode) {
+        return fileio_error("-pipeline hands whole images between its stages, which -stream does not hold.");
+    }
+    if (opts->batch_source[0] != '\0' && (opts->symbol_name[0] != '\0' || opts->debug_mode)) {
+        return fileio_error("-symbol and -debug name a single image and cannot be used with -batch.");
+    }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
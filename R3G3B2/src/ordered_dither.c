@@ -0,0 +1,319 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "constrains.h"
+#include "color.h"
+#include "dither.h"
+#include "fileio.h"
+#include "ordered_dither.h"
+#include "error.h"
+
+/*
+ * A build that targets SSSE3 always takes the SIMD path. Other x86 builds compile only the SIMD
+ * functions for SSSE3 and take them when the CPU reports it, so the default build uses them too.
+ */
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define ORDERED_DITHER_SSSE3 1
+#define SSSE3_FUNCTION
+static bool cpu_has_ssse3(void) { return true; }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define ORDERED_DITHER_SSSE3 1
+#define SSSE3_FUNCTION __attribute__((target("ssse3")))
+static bool cpu_has_ssse3(void) { return __builtin_cpu_supports("ssse3") != 0; }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <tmmintrin.h>
+#define ORDERED_DITHER_SSSE3 1
+#define SSSE3_FUNCTION
+static bool cpu_has_ssse3(void)
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0; // CPUID 1, ECX bit 9
+}
+#endif
+
+// Pixels per SIMD step
+#define ORDERED_BLOCK 16
+
+// Most level boundaries a channel has (red and green have 8 levels)
+#define MAX_CHANNEL_BOUNDARIES (RED_LEVELS - 1)
+
+static const int CHANNEL_LEVELS[RGB_COMPONENTS] = { RED_LEVELS, GREEN_LEVELS, BLUE_LEVELS };
+
+/*
+ * A threshold only ever moves a channel value by an offset of its own, so the index bits a channel
+ * contributes depend on nothing but the threshold and the (LUT adjusted) value: bits[t][c][v].
+ * Per pixel that is three loads and two ORs.
+ *
+ * When every such step function rises with v, channel c reaches level k exactly when
+ * v >= bounds[row][c][k - 1][col]. The SIMD path compares 16 pixels against those boundary rows
+ * and adds up the weighted masks, so the palette search disappears from the inner loop.
+ */
+struct OrderedDither {
+    int size;
+    const uint8_t* matrix;
+    uint8_t bits[LUT_SIZE][RGB_COMPONENTS][LUT_SIZE];
+    uint8_t* bounds;       // size rows x channels x boundaries x size columns, NULL when not usable
+};
+
+static int clamp_colour(int value)
+{
+    return (value > MAX_COLOUR_VALUE) ? MAX_COLOUR_VALUE : (value < 0) ? 0 : value;
+}
+
+#ifdef ORDERED_DITHER_SSSE3
+// Boundaries for every cell, or NULL when a step function falls or never reaches a level
+static uint8_t* build_bounds(const OrderedDither* dither)
+{
+    const int size = dither->size;
+    uint8_t* bounds = (uint8_t*)malloc((size_t)size * RGB_COMPONENTS * MAX_CHANNEL_BOUNDARIES * size);
+    if (!bounds) return NULL;
+
+    for (int row = 0; row < size; row++) {
+        for (int col = 0; col < size; col++) {
+            const uint8_t t = dither->matrix[row * size + col];
+            for (int c = 0; c < RGB_COMPONENTS; c++) {
+                const uint8_t* bits = dither->bits[t][c];
+                uint8_t* cell = bounds + ((size_t)(row * RGB_COMPONENTS + c) * MAX_CHANNEL_BOUNDARIES) * size + col;
+                int level = 0;
+
+                for (int v = 0; v <= MAX_COLOUR_VALUE; v++) {
+                    const int next = bits[v] >> channelIndexShift[c];
+                    if (next < level) {
+                        free(bounds);
+                        return NULL;
+                    }
+                    for (; level < next; level++) {
+                        cell[(size_t)level * size] = (uint8_t)v;
+                    }
+                }
+                if (level != CHANNEL_LEVELS[c] - 1) {
+                    free(bounds);
+                    return NULL;
+                }
+            }
+        }
+    }
+    return bounds;
+}
+#endif
+
+OrderedDither* ordered_dither_create(const uint8_t* matrix, int size, OrderedSpread spread, const ToneLut* lut)
+{
+    if (!matrix || size < ORDERED_BLOCK || (size & (size - 1)) != 0) {
+        fileio_error("Ordered dither matrix size must be a power of two of at least 16.");
+        return NULL;
+    }
+    if (initialize_channel_quantizer() != EXIT_SUCCESS) {
+        return NULL;
+    }
+
+    OrderedDither* dither = (OrderedDither*)malloc(sizeof(OrderedDither));
+    if (!dither) {
+        fileio_error("Failed to allocate ordered dither tables.");
+        return NULL;
+    }
+    dither->size = size;
+    dither->matrix = matrix;
+
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        const float step = (float)MAX_COLOUR_VALUE / (float)(CHANNEL_LEVELS[c] - 1);
+        for (int t = 0; t < LUT_SIZE; t++) {
+            // The Bayer spread is the original per-pixel arithmetic, so the tables reproduce it exactly
+            const float offset = (spread == ORDERED_SPREAD_LEVEL_STEP) ? ((float)t + 0.5f) / (float)LUT_SIZE * step - step * 0.5f
+                                                                       : (float)(t - 128) / 8.0f;
+            for (int v = 0; v < LUT_SIZE; v++) {
+                const uint8_t value = lut ? lut->channel[c][v] : (uint8_t)v;
+                const int adjusted = clamp_colour((int)round((float)value + offset));
+                dither->bits[t][c][v] = (uint8_t)(palette_channel_level(c, (uint8_t)adjusted) << channelIndexShift[c]);
+            }
+        }
+    }
+
+#ifdef ORDERED_DITHER_SSSE3
+    dither->bounds = cpu_has_ssse3() ? build_bounds(dither) : NULL;
+#else
+    dither->bounds = NULL;
+#endif
+    return dither;
+}
+
+void ordered_dither_free(OrderedDither* dither)
+{
+    if (!dither) return;
+    free(dither->bounds);
+    free(dither);
+}
+
+static void ordered_row_scalar(const OrderedDither* dither, const uint8_t* src, uint8_t* dst, int y, int x_begin, int width)
+{
+    const int mask = dither->size - 1;
+    const uint8_t* thresholds = dither->matrix + (size_t)(y & mask) * dither->size;
+
+    src += (size_t)x_begin * RGB_COMPONENTS;
+    for (int x = x_begin; x < width; x++, src += RGB_COMPONENTS) {
+        const uint8_t (*bits)[LUT_SIZE] = dither->bits[thresholds[x & mask]];
+        dst[x] = bits[0][src[0]] | bits[1][src[1]] | bits[2][src[2]];
+    }
+}
+
+#ifdef ORDERED_DITHER_SSSE3
+// Shuffle masks gathering channel c of 16 packed RGB pixels from each of the three 16-byte loads
+SSSE3_FUNCTION static void build_deinterleave_masks(__m128i masks[RGB_COMPONENTS][RGB_COMPONENTS])
+{
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        for (int part = 0; part < RGB_COMPONENTS; part++) {
+            uint8_t lanes[ORDERED_BLOCK];
+            for (int i = 0; i < ORDERED_BLOCK; i++) {
+                const int byte = i * RGB_COMPONENTS + c - part * ORDERED_BLOCK;
+                lanes[i] = (byte >= 0 && byte < ORDERED_BLOCK) ? (uint8_t)byte : 0x80;
+            }
+            masks[c][part] = _mm_loadu_si128((const __m128i*)lanes);
+        }
+    }
+}
+
+// Counts the boundaries each lane has reached, weighted by the channel's place in the index
+SSSE3_FUNCTION static __m128i channel_bits(__m128i value, const uint8_t* bounds, int count, size_t stride, __m128i weight)
+{
+    __m128i sum = _mm_setzero_si128();
+    for (int k = 0; k < count; k++) {
+        const __m128i bound = _mm_loadu_si128((const __m128i*)(bounds + k * stride));
+        const __m128i reached = _mm_cmpeq_epi8(_mm_max_epu8(value, bound), value);
+        sum = _mm_add_epi8(sum, _mm_and_si128(reached, weight));
+    }
+    return sum;
+}
+
+SSSE3_FUNCTION static int ordered_row_simd(const OrderedDither* dither, const uint8_t* src, uint8_t* dst, int y, int width)
+{
+    const int size = dither->size;
+    const size_t stride = (size_t)size;
+    const uint8_t* row_bounds = dither->bounds + (size_t)(y & (size - 1)) * RGB_COMPONENTS * MAX_CHANNEL_BOUNDARIES * stride;
+    __m128i masks[RGB_COMPONENTS][RGB_COMPONENTS];
+    __m128i weights[RGB_COMPONENTS];
+    build_deinterleave_masks(masks);
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        weights[c] = _mm_set1_epi8((char)(1 << channelIndexShift[c]));
+    }
+
+    int x = 0;
+    for (; x + ORDERED_BLOCK <= width; x += ORDERED_BLOCK) {
+        const uint8_t* p = src + (size_t)x * RGB_COMPONENTS;
+        const __m128i in0 = _mm_loadu_si128((const __m128i*)p);
+        const __m128i in1 = _mm_loadu_si128((const __m128i*)(p + ORDERED_BLOCK));
+        const __m128i in2 = _mm_loadu_si128((const __m128i*)(p + 2 * ORDERED_BLOCK));
+        const int col = x & (size - 1);
+        __m128i index = _mm_setzero_si128();
+
+        for (int c = 0; c < RGB_COMPONENTS; c++) {
+            const __m128i value = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, masks[c][0]), _mm_shuffle_epi8(in1, masks[c][1])),
+                                               _mm_shuffle_epi8(in2, masks[c][2]));
+            const uint8_t* bounds = row_bounds + (size_t)c * MAX_CHANNEL_BOUNDARIES * stride + col;
+            index = _mm_or_si128(index, channel_bits(value, bounds, CHANNEL_LEVELS[c] - 1, stride, weights[c]));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x), index);
+    }
+    return x;
+}
+#endif
+
+void ordered_dither_row(const uint8_t* src, uint8_t* dst, int y, int width, const void* context)
+{
+    const OrderedDither* dither = (const OrderedDither*)context;
+    int x = 0;
+
+#ifdef ORDERED_DITHER_SSSE3
+    if (dither->bounds) {
+        x = ordered_row_simd(dither, src, dst, y, width);
+    }
+#endif
+    ordered_row_scalar(dither, src, dst, y, x, width);
+}
+
+int ordered_dither_image(ImageData* image, ThreadPool* pool, const OrderedDither* dither, const char* name)
+{
+    if (!dither) {
+        return fileio_error("Null pointer passed to ordered_dither_image.");
+    }
+    return run_index_rows(image, pool, ordered_dither_row, dither, name);
+}
+
+bool ordered_dither_simd_available(void)
+{
+#ifdef ORDERED_DITHER_SSSE3
+    return cpu_has_ssse3();
+#else
+    return false;
+#endif
+}
+
+// Runs the -dm 3 and -dm 4 tables, without a LUT and with a contrast LUT, over a noisy image whose
+// width is not a multiple of the SIMD step. Each row goes through ordered_dither_row and through
+// the scalar loop alone. Returns the number of indices that differ, or -1 if a table failed.
+long verify_ordered_simd(void)
+{
+    static const struct {
+        OrderedSpread spread;
+        int size;
+    } methods[] = {
+        { ORDERED_SPREAD_FIXED,      BAYER_SIZE },
+        { ORDERED_SPREAD_LEVEL_STEP, BLUE_NOISE_SIZE },
+    };
+    const uint8_t* matrices[] = { bayer16x16_matrix(), blue_noise64x64_matrix() };
+    const int width = 203;
+    const int height = 131;
+
+    ToneLut contrast;
+    for (int c = 0; c < RGB_COMPONENTS; c++) {
+        for (int v = 0; v < LUT_SIZE; v++) {
+            contrast.channel[c][v] = (uint8_t)clamp_colour((v - 128) * 3 / 2 + 128 + c * 8);
+        }
+    }
+    const ToneLut* luts[] = { NULL, &contrast };
+
+    uint8_t* rgb = (uint8_t*)malloc((size_t)width * height * RGB_COMPONENTS + 2 * (size_t)width);
+    if (!rgb) return -1;
+    uint8_t* simd = rgb + (size_t)width * height * RGB_COMPONENTS;
+    uint8_t* scalar = simd + width;
+    uint32_t seed = 0x2545F491u;
+    for (size_t i = 0; i < (size_t)width * height * RGB_COMPONENTS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        rgb[i] = (uint8_t)(seed >> 24);
+    }
+
+    long mismatches = 0;
+    for (int m = 0; m < 2 && mismatches >= 0; m++) {
+        for (int l = 0; l < 2; l++) {
+            OrderedDither* dither = ordered_dither_create(matrices[m], methods[m].size, methods[m].spread, luts[l]);
+            if (!dither) {
+                mismatches = -1;
+                break;
+            }
+            for (int y = 0; y < height; y++) {
+                const uint8_t* row = rgb + (size_t)y * width * RGB_COMPONENTS;
+                ordered_dither_row(row, simd, y, width, dither);
+                ordered_row_scalar(dither, row, scalar, y, 0, width);
+                for (int x = 0; x < width; x++) {
+                    mismatches += simd[x] != scalar[x];
+                }
+            }
+            ordered_dither_free(dither);
+        }
+    }
+    free(rgb);
+    return mismatches;
+}
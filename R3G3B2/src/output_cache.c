@@ -0,0 +1,505 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#endif
+
+#include "constrains.h"
+#include "output_cache.h"
+#include "error.h"
+
+// Chunk the input is hashed and files are copied in; a multiple of the hash stripe
+#define CACHE_IO_CHUNK (1024 * 1024)
+
+#define HASH_STRIPE 32
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+
+// "<key>.<n>": 16 hex digits, a dot and the output index
+#define ENTRY_NAME_LENGTH 18
+
+#define STATS_FILENAME "stats.log"
+
+/*
+ * A 64-bit hash over four independent lanes of 8-byte words, so the multiplies of a 32-byte
+ * stripe overlap and hashing runs at memory speed. It only has to tell inputs apart, not resist
+ * anyone crafting collisions.
+ */
+typedef struct {
+    uint64_t lane[4];
+    uint64_t length;
+} Hasher;
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t load_u64le(const uint8_t* p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    return rotate_left(accumulator + input * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+static void hasher_init(Hasher* hasher, uint64_t seed)
+{
+    hasher->lane[0] = seed + HASH_PRIME1 + HASH_PRIME2;
+    hasher->lane[1] = seed + HASH_PRIME2;
+    hasher->lane[2] = seed;
+    hasher->lane[3] = seed - HASH_PRIME1;
+    hasher->length = 0;
+}
+
+// size must be a multiple of HASH_STRIPE
+static void hasher_stripes(Hasher* hasher, const uint8_t* bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i += HASH_STRIPE) {
+        for (int lane = 0; lane < 4; lane++) {
+            hasher->lane[lane] = hash_round(hasher->lane[lane], load_u64le(bytes + i + lane * 8));
+        }
+    }
+    hasher->length += size;
+}
+
+// The final, partial stripe
+static uint64_t hasher_finish(Hasher* hasher, const uint8_t* tail, size_t size)
+{
+    uint64_t hash = rotate_left(hasher->lane[0], 1) + rotate_left(hasher->lane[1], 7) +
+                    rotate_left(hasher->lane[2], 12) + rotate_left(hasher->lane[3], 18);
+    hash ^= hasher->length + size;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        hash = rotate_left(hash ^ hash_round(0, load_u64le(tail + i)), 27) * HASH_PRIME1 + HASH_PRIME3;
+    }
+    for (; i < size; i++) {
+        hash = rotate_left(hash ^ (tail[i] * HASH_PRIME3), 11) * HASH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME3;
+    return hash ^ (hash >> 32);
+}
+
+static uint64_t hash_bytes(uint64_t seed, const void* bytes, size_t size)
+{
+    Hasher hasher;
+    const size_t stripes = size - size % HASH_STRIPE;
+    hasher_init(&hasher, seed);
+    hasher_stripes(&hasher, (const uint8_t*)bytes, stripes);
+    return hasher_finish(&hasher, (const uint8_t*)bytes + stripes, size - stripes);
+}
+
+static int hash_file(const char* filename, uint64_t* hash)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        return fileio_perror("Failed to open input file");
+    }
+    uint8_t* buffer = (uint8_t*)malloc(CACHE_IO_CHUNK);
+    if (!buffer) {
+        fclose(fp);
+        return fileio_error("Failed to allocate hash buffer.");
+    }
+
+    Hasher hasher;
+    hasher_init(&hasher, 0);
+    size_t size;
+    // Only the last read comes up short, so every earlier chunk is whole stripes
+    while ((size = fread(buffer, 1, CACHE_IO_CHUNK, fp)) == CACHE_IO_CHUNK) {
+        hasher_stripes(&hasher, buffer, size);
+    }
+    const bool failed = ferror(fp) != 0;
+    const size_t stripes = size - size % HASH_STRIPE;
+    hasher_stripes(&hasher, buffer, stripes);
+    *hash = hasher_finish(&hasher, buffer + stripes, size - stripes);
+
+    free(buffer);
+    fclose(fp);
+    return failed ? fileio_perror("Failed to read input file") : EXIT_SUCCESS;
+}
+
+static bool file_exists(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    fclose(fp);
+    return true;
+}
+
+// Marks a file as just used, for the LRU order
+static void touch_file(const char* path)
+{
+#if defined(_WIN32)
+    _utime(path, NULL);
+#else
+    utime(path, NULL);
+#endif
+}
+
+// Copies from to to; on Linux a filesystem that can share extents (Btrfs, XFS) reflinks instead
+static bool copy_file(const char* from, const char* to, uint64_t* size)
+{
+#if defined(_WIN32)
+    if (!CopyFileA(from, to, FALSE)) return false;
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(to, GetFileExInfoStandard, &attributes)) return false;
+    *size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    return true;
+#else
+    const int source = open(from, O_RDONLY);
+    if (source < 0) return false;
+    const int destination = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (destination < 0) {
+        close(source);
+        return false;
+    }
+
+    struct stat status;
+    bool copied = fstat(source, &status) == 0;
+    *size = copied ? (uint64_t)status.st_size : 0;
+#if defined(FICLONE)
+    if (copied && ioctl(destination, FICLONE, source) == 0) {
+        close(source);
+        return close(destination) == 0;
+    }
+#endif
+    char* buffer = copied ? (char*)malloc(CACHE_IO_CHUNK) : NULL;
+    copied = buffer != NULL;
+    for (ssize_t count; copied && (count = read(source, buffer, CACHE_IO_CHUNK)) != 0; ) {
+        copied = count > 0 && write(destination, buffer, (size_t)count) == count;
+    }
+    free(buffer);
+    close(source);
+    return close(destination) == 0 && copied;
+#endif
+}
+
+static bool entry_filename(const OutputCache* cache, const char* key, int index, const char* suffix, char* dest, size_t dest_size)
+{
+    const int written = snprintf(dest, dest_size, "%s/%s.%d%s", cache->directory, key, index, suffix);
+    return written >= 0 && (size_t)written < dest_size;
+}
+
+// Lookups are logged one line each, "<hits> <misses> <bytes restored>", so concurrent runs only append
+static void log_lookup(const char* directory, bool hit, uint64_t bytes)
+{
+    char path[MAX_FILENAME_LENGTH + 16];
+    snprintf(path, sizeof(path), "%s/%s", directory, STATS_FILENAME);
+    FILE* fp = fopen(path, "a");
+    if (!fp) return;
+    fprintf(fp, "%d %d %llu\n", hit ? 1 : 0, hit ? 0 : 1, (unsigned long long)bytes);
+    fclose(fp);
+}
+
+int output_cache_open(OutputCache* cache, const ProgramOptions* opts, const char* array_name, const OutputFormat* format)
+{
+    if (!cache || !opts || !array_name || !format) {
+        return fileio_error("Null pointer passed to output_cache_open.");
+    }
+
+    memset(cache, 0, sizeof(OutputCache));
+    const int written = snprintf(cache->directory, sizeof(cache->directory), "%s", opts->cache_directory);
+    if (written < 0 || written >= (int)sizeof(cache->directory)) {
+        return fileio_error("Cache directory name is too long.");
+    }
+    if (!make_directory(cache->directory)) {
+        return fileio_perror("Failed to create cache directory");
+    }
+    cache->if_changed = format->if_changed;
+    cache->output_count = output_file_names(opts->outfilename, array_name, format, cache->outputs);
+    if (cache->output_count < 0) {
+        return fileio_error("Output file name is too long to cache.");
+    }
+
+    uint64_t input_hash = 0;
+    uint64_t curves_hash = 0;
+    if (hash_file(opts->infilename, &input_hash) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (opts->curves_filename[0] != '\0' && hash_file(opts->curves_filename, &curves_hash) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // Everything that changes the bytes written; threads, -channels and -stream do not
+    char description[4 * MAX_FILENAME_LENGTH];
+    int length = snprintf(description, sizeof(description), "%s|%d|%a|%a|%a|%016llx|%d%d%d%d|%d|%d|%s|%d|%dx%d|%s",
+                          R3G3B2_VERSION, opts->dither_method, opts->gamma, opts->contrast, opts->lightness,
+                          (unsigned long long)curves_hash, format->header_output, format->bin_output, (int)format->elf_arch,
+                          format->asm_output, (int)format->encoding, format->split_source, format->section ? format->section : "",
+                          format->alignment, opts->raw_width, opts->raw_height, array_name);
+    for (int i = 0; i < cache->output_count && length >= 0 && (size_t)length < sizeof(description); i++) {
+        length += snprintf(description + length, sizeof(description) - length, "|%s", base_name(cache->outputs[i]));
+    }
+    if (length < 0 || (size_t)length >= sizeof(description)) {
+        return fileio_error("Options are too long to cache.");
+    }
+
+    snprintf(cache->key, sizeof(cache->key), "%016llx", (unsigned long long)hash_bytes(input_hash, description, (size_t)length));
+    return EXIT_SUCCESS;
+}
+
+int output_cache_restore(const OutputCache* cache, size_t* bytes)
+{
+    char path[MAX_FILENAME_LENGTH + 32];
+    uint64_t total = 0;
+
+    for (int i = 0; i < cache->output_count; i++) {
+        if (!entry_filename(cache, cache->key, i, "", path, sizeof(path)) || !file_exists(path)) {
+            log_lookup(cache->directory, false, 0);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < cache->output_count; i++) {
+        char temporary[TEMPORARY_FILENAME_LENGTH];
+        uint64_t size = 0;
+        entry_filename(cache, cache->key, i, "", path, sizeof(path));
+        temporary_filename(cache->outputs[i], temporary, sizeof(temporary));
+
+        // With -if-changed an output that already matches is not touched and counts no bytes
+        bool restored = true;
+        if (!cache->if_changed) {
+            restored = copy_file(path, cache->outputs[i], &size);
+        }
+        else if (!files_equal(path, cache->outputs[i])) {
+            restored = copy_file(path, temporary, &size) && copy_file_mode(cache->outputs[i], temporary) &&
+                       replace_file(temporary, cache->outputs[i]);
+            if (!restored) remove(temporary);
+        }
+        if (!restored) {
+            // Most likely evicted by a concurrent run; converting rewrites the outputs
+            log_lookup(cache->directory, false, 0);
+            return EXIT_FAILURE;
+        }
+        touch_file(path);
+        total += size;
+    }
+
+    log_lookup(cache->directory, true, total);
+    if (bytes) {
+        *bytes = (size_t)total;
+    }
+    return EXIT_SUCCESS;
+}
+
+typedef struct {
+    char name[ENTRY_NAME_LENGTH + 1];
+    uint64_t size;
+    int64_t used;   // Modification time, refreshed on every hit
+} CacheFile;
+
+static bool is_entry_name(const char* name)
+{
+    if (strlen(name) != ENTRY_NAME_LENGTH || name[16] != '.' || !isdigit((unsigned char)name[17])) return false;
+    for (int i = 0; i < 16; i++) {
+        if (!isxdigit((unsigned char)name[i])) return false;
+    }
+    return true;
+}
+
+static bool add_cache_file(CacheFile** files, size_t* count, size_t* capacity, const char* name, uint64_t size, int64_t used)
+{
+    if (*count == *capacity) {
+        const size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        CacheFile* grown = (CacheFile*)realloc(*files, grown_capacity * sizeof(CacheFile));
+        if (!grown) return false;
+        *files = grown;
+        *capacity = grown_capacity;
+    }
+    CacheFile* file = &(*files)[(*count)++];
+    strcpy(file->name, name);
+    file->size = size;
+    file->used = used;
+    return true;
+}
+
+// Every entry file of the cache; *files is malloc'd
+static int list_entry_files(const char* directory, CacheFile** files, size_t* count)
+{
+    size_t capacity = 0;
+    *files = NULL;
+    *count = 0;
+
+#if defined(_WIN32)
+    char pattern[MAX_FILENAME_LENGTH + 8];
+    snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return fileio_error("Failed to list cache directory.");
+    }
+    do {
+        if (!is_entry_name(found.cFileName)) continue;
+        const uint64_t size = ((uint64_t)found.nFileSizeHigh << 32) | found.nFileSizeLow;
+        const int64_t used = (int64_t)(((uint64_t)found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime);
+        if (!add_cache_file(files, count, &capacity, found.cFileName, size, used)) {
+            FindClose(search);
+            return fileio_error("Failed to allocate cache listing.");
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR* dir = opendir(directory);
+    if (!dir) {
+        return fileio_perror("Failed to list cache directory");
+    }
+    for (struct dirent* entry; (entry = readdir(dir)) != NULL; ) {
+        char path[MAX_FILENAME_LENGTH + 32];
+        struct stat status;
+        if (!is_entry_name(entry->d_name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        if (stat(path, &status) != 0) continue; // Evicted meanwhile
+        if (!add_cache_file(files, count, &capacity, entry->d_name, (uint64_t)status.st_size, (int64_t)status.st_mtime)) {
+            closedir(dir);
+            return fileio_error("Failed to allocate cache listing.");
+        }
+    }
+    closedir(dir);
+#endif
+    return EXIT_SUCCESS;
+}
+
+static int compare_least_recent(const void* a, const void* b)
+{
+    const CacheFile* first = (const CacheFile*)a;
+    const CacheFile* second = (const CacheFile*)b;
+    if (first->used != second->used) return (first->used < second->used) ? -1 : 1;
+    return strcmp(first->name, second->name); // Keeps the files of one entry together
+}
+
+// Removes the least recently used files until the cache fits in limit bytes
+static int evict_entries(const char* directory, uint64_t limit)
+{
+    CacheFile* files;
+    size_t count;
+    if (list_entry_files(directory, &files, &count) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) total += files[i].size;
+
+    if (total > limit) {
+        qsort(files, count, sizeof(CacheFile), compare_least_recent);
+        for (size_t i = 0; i < count && total > limit; i++) {
+            char path[MAX_FILENAME_LENGTH + 32];
+            snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+            remove(path);
+            total -= files[i].size;
+        }
+    }
+    free(files);
+    return EXIT_SUCCESS;
+}
+
+int output_cache_store(const OutputCache* cache, long size_mib)
+{
+    char temporary[MAX_FILENAME_LENGTH + 32];
+    char path[MAX_FILENAME_LENGTH + 32];
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%d", current_process_id());
+
+    // Each file lands under its final name in one rename, so a lookup never sees half a file
+    for (int i = 0; i < cache->output_count; i++) {
+        uint64_t size;
+        if (!entry_filename(cache, cache->key, i, suffix, temporary, sizeof(temporary)) ||
+            !entry_filename(cache, cache->key, i, "", path, sizeof(path))) {
+            return fileio_error("Cache file name is too long.");
+        }
+        if (!copy_file(cache->outputs[i], temporary, &size) || !replace_file(temporary, path)) {
+            remove(temporary);
+            return fileio_perror("Failed to store output in the cache");
+        }
+    }
+    return evict_entries(cache->directory, (uint64_t)size_mib * 1024 * 1024);
+}
+
+int output_cache_print_stats(const char* directory)
+{
+    char path[MAX_FILENAME_LENGTH + 16];
+    unsigned long long hits = 0, misses = 0, bytes = 0;
+    snprintf(path, sizeof(path), "%s/%s", directory, STATS_FILENAME);
+
+    FILE* fp = fopen(path, "r");
+    if (fp) {
+        unsigned long long line_hits, line_misses, line_bytes;
+        while (fscanf(fp, "%llu %llu %llu", &line_hits, &line_misses, &line_bytes) == 3) {
+            hits += line_hits;
+            misses += line_misses;
+            bytes += line_bytes;
+        }
+        fclose(fp);
+
+        // Fold the log into one line; lookups logged while this runs may be lost, which only skews the counts
+        char temporary[MAX_FILENAME_LENGTH + 32];
+        snprintf(temporary, sizeof(temporary), "%s.tmp%d", path, current_process_id());
+        FILE* compacted = fopen(temporary, "w");
+        if (compacted) {
+            const bool written = fprintf(compacted, "%llu %llu %llu\n", hits, misses, bytes) > 0;
+            if (fclose(compacted) != 0 || !written || !replace_file(temporary, path)) {
+                remove(temporary);
+            }
+        }
+    }
+
+    CacheFile* files;
+    size_t count;
+    if (list_entry_files(directory, &files, &count) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    uint64_t total = 0;
+    size_t entries = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += files[i].size;
+        entries += files[i].name[17] == '0';
+    }
+    free(files);
+
+    const unsigned long long lookups = hits + misses;
+    printf("Cache %s (" R3G3B2_VERSION ")\n", directory);
+    printf("  Lookups: %llu (%llu hits, %llu misses), hit rate %.1f%%\n", lookups, hits, misses,
+           lookups ? 100.0 * (double)hits / (double)lookups : 0.0);
+    printf("  Bytes restored from the cache: %llu (%.1f MiB)\n", bytes, (double)bytes / (1024.0 * 1024.0));
+    printf("  Entries: %zu in %zu files, %.1f MiB\n", entries, count, (double)total / (1024.0 * 1024.0));
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -6,11 +6,19 @@
  *                                                       *
  *********************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
+#include "color.h"
+#include "dither.h"
+#include "ordered_dither.h"
+#include "error.h"
 #include "options.h"
 #include "fileio.h"
 #include "image_process.h"
+#include "output_cache.h"
+#include "batch.h"
 
 int main(int argc, char* argv[]) {
     ProgramOptions opts;
@@ -18,5 +26,32 @@ int main(int argc, char* argv[]) {
     if (parse_command_line_args(argc, argv, &opts) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
+    if (opts.self_test) {
+        long mismatches = verify_separable_quantizer();
+        printf("Separable quantizer: %ld mismatches over 16777216 colours\n", mismatches);
+        long dither_mismatches = verify_parallel_dither();
+        if (dither_mismatches < 0) {
+            return fileio_error("Failed to run the parallel dither check.");
+        }
+        printf("Parallel error diffusion: %ld indices differ from the one-thread kernels\n", dither_mismatches);
+        long ordered_mismatches = 0;
+        if (ordered_dither_simd_available()) {
+            ordered_mismatches = verify_ordered_simd();
+            if (ordered_mismatches < 0) {
+                return fileio_error("Failed to run the SSSE3 ordered dither check.");
+            }
+            printf("SSSE3 ordered dither: %ld indices differ from the scalar path\n", ordered_mismatches);
+        }
+        else {
+            printf("SSSE3 ordered dither: not used by this build or CPU, nothing to check\n");
+        }
+        return (mismatches == 0 && dither_mismatches == 0 && ordered_mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (opts.cache_stats) {
+        return output_cache_print_stats(opts.cache_directory);
+    }
+    if (opts.batch_source[0] != '\0') {
+        return process_batch(&opts);
+    }
     return process_image(&opts);
 }
\ No newline at end of file
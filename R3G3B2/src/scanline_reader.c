@@ -0,0 +1,711 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "constrains.h"
+#include "inflate.h"
+#include "scanline_reader.h"
+#include "fileio.h"
+#include "stb_image.h"
+#include "error.h"
+
+typedef enum {
+    SOURCE_PNM = 0,
+    SOURCE_BMP,
+    SOURCE_TGA,
+    SOURCE_PNG,
+    SOURCE_DECODED  // Whole image decoded by stb_image
+} SourceKind;
+
+/*
+ * Every streamed format keeps one stored row (raw) and converts it to RGB. Bottom-up BMP and
+ * TGA files are read with a seek per row, so rows still come out top first. Formats that cannot
+ * be streamed from here (RLE BMP, bottom-up RLE TGA, interlaced PNG, 16-bit PPM, ...) take the
+ * stb_image route, which keeps their results identical to load_image.
+ */
+struct ScanlineReader {
+    FILE* fp;
+    SourceKind kind;
+    int width;
+    int height;
+    int next_row;
+    uint8_t* raw;            // One row as stored in the file
+    size_t raw_stride;       // Bytes per stored row, BMP padding included
+    int channels;            // Samples per pixel in the stored row
+    int bits;                // Bits per sample (PNG, PNM) or per pixel (BMP)
+    uint64_t data_offset;
+    bool bottom_up;
+    uint8_t palette[256][RGB_COMPONENTS];
+    int palette_size;
+
+    // TGA run-length packets may run over the end of a row
+    bool rle;
+    int packet_left;
+    bool packet_repeat;
+    uint8_t packet_pixel[4];
+
+    // PNG
+    Inflater* inflater;
+    uint8_t* previous;       // Previous row after unfiltering, for the Up, Average and Paeth filters
+    int color_type;
+    int filter_bpp;          // Bytes per complete pixel, at least 1
+    uint32_t chunk_left;     // Bytes of the current IDAT chunk still to read
+    bool idat_done;
+
+    uint8_t* decoded;
+};
+
+static uint32_t get_u32be(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+
+static int seek_to(FILE* fp, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(fp, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static bool read_exact(FILE* fp, void* buffer, size_t size)
+{
+    return fread(buffer, 1, size, fp) == size;
+}
+
+// ---- PNM: P5 (gray), P6 (RGB) and P7 (PAM) ----
+
+static int pnm_next_char(FILE* fp)
+{
+    int c = fgetc(fp);
+    while (c == '#') {
+        while (c != EOF && c != '\n' && c != '\r') c = fgetc(fp);
+        if (c != EOF) c = fgetc(fp);
+    }
+    return c;
+}
+
+// Reads an unsigned decimal; the single character after it is consumed, as the format requires
+static bool pnm_read_int(FILE* fp, int* value)
+{
+    int c = pnm_next_char(fp);
+    while (c != EOF && isspace(c)) c = pnm_next_char(fp);
+    if (c == EOF || !isdigit(c)) return false;
+
+    long result = 0;
+    while (c != EOF && isdigit(c)) {
+        result = result * 10 + (c - '0');
+        if (result > 0x7FFFFFFF) return false;
+        c = fgetc(fp);
+    }
+    *value = (int)result;
+    return true;
+}
+
+static bool open_pam(ScanlineReader* reader, int* maxval)
+{
+    char line[256];
+    int depth = 0;
+
+    reader->width = reader->height = 0;
+    *maxval = 0;
+    while (fgets(line, sizeof(line), reader->fp)) {
+        char key[32];
+        int value;
+        if (line[0] == '#') continue;
+        if (strncmp(line, "ENDHDR", 6) == 0) {
+            reader->channels = depth;
+            return reader->width > 0 && reader->height > 0 && depth >= 1 && depth <= 4 && *maxval > 0 && *maxval <= 65535;
+        }
+        if (sscanf(line, "%31s %d", key, &value) != 2) continue;
+        if (strcmp(key, "WIDTH") == 0)       reader->width = value;
+        else if (strcmp(key, "HEIGHT") == 0) reader->height = value;
+        else if (strcmp(key, "DEPTH") == 0)  depth = value;
+        else if (strcmp(key, "MAXVAL") == 0) *maxval = value;
+    }
+    return false;
+}
+
+// Returns false when the file should go to stb_image instead
+static bool open_pnm(ScanlineReader* reader, char type)
+{
+    int maxval;
+
+    if (type == '7') {
+        if (fgetc(reader->fp) != '\n' || !open_pam(reader, &maxval)) return false;
+        reader->bits = (maxval > 255) ? 16 : 8;
+    }
+    else {
+        reader->channels = (type == '6') ? RGB_COMPONENTS : 1;
+        if (!pnm_read_int(reader->fp, &reader->width) || !pnm_read_int(reader->fp, &reader->height) ||
+            !pnm_read_int(reader->fp, &maxval) || reader->width <= 0 || reader->height <= 0) {
+            return false;
+        }
+        // stb_image keeps 16-bit PNM samples in its own byte order; leave those to it
+        if (maxval > 255) return false;
+        reader->bits = 8;
+    }
+
+    reader->kind = SOURCE_PNM;
+    reader->raw_stride = (size_t)reader->width * reader->channels * (reader->bits / 8);
+    return true;
+}
+
+// ---- BMP: uncompressed 1, 4, 8, 24 and 32 bits per pixel ----
+
+static bool open_bmp(ScanlineReader* reader)
+{
+    uint8_t header[14 + 124 + 12];
+
+    if (!read_exact(reader->fp, header, 18)) return false;
+    const uint32_t offset = get_u32le(header + 10);
+    const uint32_t hsz = get_u32le(header + 14);
+    if (hsz != 40 && hsz != 56 && hsz != 108 && hsz != 124) return false;
+    if (!read_exact(reader->fp, header + 18, hsz - 4)) return false;
+
+    const int32_t width = (int32_t)get_u32le(header + 18);
+    const int32_t height = (int32_t)get_u32le(header + 22);
+    const int bpp = get_u16le(header + 28);
+    const uint32_t compression = get_u32le(header + 30);
+
+    if (compression == 3) {
+        // Only the plain byte-aligned BGRX layout; other masks need stb_image's rescaling
+        const uint8_t* masks = header + 54;
+        if (hsz == 40 || hsz == 56) {
+            if (hsz == 56 || !read_exact(reader->fp, header + 54, 12)) return false;
+        }
+        if (bpp != 32 || get_u32le(masks) != 0x00FF0000 || get_u32le(masks + 4) != 0x0000FF00 || get_u32le(masks + 8) != 0x000000FF) {
+            return false;
+        }
+    }
+    else if (compression != 0) {
+        return false;
+    }
+    if (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32) return false;
+    if (width <= 0 || height == 0 || height == INT32_MIN) return false;
+
+    reader->width = width;
+    reader->height = (height < 0) ? -height : height;
+    reader->bottom_up = (height > 0);
+    reader->bits = bpp;
+    reader->raw_stride = (((size_t)width * bpp + 31) / 32) * 4;
+    reader->data_offset = offset;
+
+    if (bpp < 16) {
+        // Same palette size rule as stb_image: whatever fits between the header and the pixels
+        const long palette_start = 14 + (long)hsz;
+        const long palette_size = ((long)offset - palette_start) / 4;
+        if (palette_size <= 0 || palette_size > 256) return false;
+        if (seek_to(reader->fp, (uint64_t)palette_start) != 0) return false;
+        memset(reader->palette, 0, sizeof(reader->palette));
+        for (long i = 0; i < palette_size; i++) {
+            uint8_t entry[4];
+            if (!read_exact(reader->fp, entry, 4)) return false;
+            reader->palette[i][0] = entry[2];
+            reader->palette[i][1] = entry[1];
+            reader->palette[i][2] = entry[0];
+        }
+        reader->palette_size = (int)palette_size;
+    }
+
+    reader->kind = SOURCE_BMP;
+    return seek_to(reader->fp, offset) == 0;
+}
+
+// ---- TGA: true colour, gray and 8-bit colour mapped, raw or run-length encoded ----
+
+static bool open_tga(ScanlineReader* reader)
+{
+    uint8_t header[18];
+
+    if (!read_exact(reader->fp, header, sizeof(header))) return false;
+    const int id_length = header[0];
+    const int colormap_type = header[1];
+    const int image_type = header[2];
+    const int palette_start = get_u16le(header + 3);
+    const int palette_length = get_u16le(header + 5);
+    const int palette_bits = header[7];
+    const int bpp = header[16];
+    const int base_type = image_type & 7;
+
+    reader->width = get_u16le(header + 12);
+    reader->height = get_u16le(header + 14);
+    reader->rle = (image_type & 8) != 0;
+    reader->bottom_up = ((header[17] >> 5) & 1) == 0;
+    if (reader->width == 0 || reader->height == 0) return false;
+
+    // Bottom-up rows can only be found again by seeking, which run-length data does not allow
+    if (reader->rle && reader->bottom_up) return false;
+
+    if (colormap_type == 0 && base_type == 2 && (bpp == 24 || bpp == 32)) {
+        reader->channels = bpp / 8;
+    }
+    else if (colormap_type == 0 && base_type == 3 && bpp == 8) {
+        reader->channels = 1;
+    }
+    else if (colormap_type == 1 && base_type == 1 && bpp == 8 && (palette_bits == 24 || palette_bits == 32) &&
+             palette_length > 0 && palette_length <= 256) {
+        const int entry_size = palette_bits / 8;
+        if (fseek(reader->fp, id_length + palette_start, SEEK_CUR) != 0) return false;
+        memset(reader->palette, 0, sizeof(reader->palette));
+        for (int i = 0; i < palette_length; i++) {
+            uint8_t entry[4];
+            if (!read_exact(reader->fp, entry, entry_size)) return false;
+            reader->palette[i][0] = entry[2];
+            reader->palette[i][1] = entry[1];
+            reader->palette[i][2] = entry[0];
+        }
+        reader->palette_size = palette_length;
+        reader->channels = 1;
+        reader->kind = SOURCE_TGA;
+        reader->raw_stride = (size_t)reader->width;
+        reader->data_offset = (uint64_t)ftell(reader->fp);
+        return true;
+    }
+    else {
+        return false;
+    }
+
+    if (fseek(reader->fp, id_length, SEEK_CUR) != 0) return false;
+    reader->kind = SOURCE_TGA;
+    reader->raw_stride = (size_t)reader->width * reader->channels;
+    reader->data_offset = (uint64_t)ftell(reader->fp);
+    return true;
+}
+
+static bool read_tga_rle_row(ScanlineReader* reader)
+{
+    const int pixel_size = reader->channels;
+    uint8_t* out = reader->raw;
+
+    for (int x = 0; x < reader->width; x++, out += pixel_size) {
+        if (reader->packet_left == 0) {
+            const int command = fgetc(reader->fp);
+            if (command == EOF) return false;
+            reader->packet_left = 1 + (command & 127);
+            reader->packet_repeat = (command & 128) != 0;
+            if (reader->packet_repeat && !read_exact(reader->fp, reader->packet_pixel, pixel_size)) return false;
+        }
+        if (reader->packet_repeat) {
+            memcpy(out, reader->packet_pixel, pixel_size);
+        }
+        else if (!read_exact(reader->fp, out, pixel_size)) {
+            return false;
+        }
+        reader->packet_left--;
+    }
+    return true;
+}
+
+// ---- PNG: any colour type and bit depth, not interlaced ----
+
+static size_t png_read_idat(void* context, uint8_t* buffer, size_t size)
+{
+    ScanlineReader* reader = (ScanlineReader*)context;
+    size_t produced = 0;
+
+    while (produced < size && !reader->idat_done) {
+        if (reader->chunk_left == 0) {
+            // Step over the CRC of the finished chunk; the image data ends at the first non-IDAT chunk
+            uint8_t chunk[12];
+            if (!read_exact(reader->fp, chunk, sizeof(chunk)) || memcmp(chunk + 8, "IDAT", 4) != 0) {
+                reader->idat_done = true;
+                break;
+            }
+            reader->chunk_left = get_u32be(chunk + 4);
+            continue;
+        }
+
+        const size_t wanted = (size - produced < reader->chunk_left) ? size - produced : reader->chunk_left;
+        const size_t got = fread(buffer + produced, 1, wanted, reader->fp);
+        if (got == 0) {
+            reader->idat_done = true;
+            break;
+        }
+        produced += got;
+        reader->chunk_left -= (uint32_t)got;
+    }
+    return produced;
+}
+
+static bool open_png(ScanlineReader* reader)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t buffer[13];
+    bool have_header = false;
+
+    if (!read_exact(reader->fp, buffer, 8) || memcmp(buffer, signature, 8) != 0) return false;
+
+    for (;;) {
+        uint8_t chunk[8];
+        if (!read_exact(reader->fp, chunk, sizeof(chunk))) return false;
+        const uint32_t length = get_u32be(chunk);
+
+        if (memcmp(chunk + 4, "IHDR", 4) == 0) {
+            if (length != 13 || !read_exact(reader->fp, buffer, 13)) return false;
+            reader->width = (int)get_u32be(buffer);
+            reader->height = (int)get_u32be(buffer + 4);
+            reader->bits = buffer[8];
+            reader->color_type = buffer[9];
+            if (buffer[10] != 0 || buffer[11] != 0 || buffer[12] != 0) return false; // Interlaced or unknown method
+            if (reader->width <= 0 || reader->height <= 0) return false;
+            switch (reader->color_type) {
+            case 0: reader->channels = 1; break;
+            case 2: reader->channels = 3; break;
+            case 3: reader->channels = 1; break;
+            case 4: reader->channels = 2; break;
+            case 6: reader->channels = 4; break;
+            default: return false;
+            }
+            if (reader->bits != 1 && reader->bits != 2 && reader->bits != 4 && reader->bits != 8 && reader->bits != 16) return false;
+            if ((reader->color_type == 3 && reader->bits == 16) || (reader->color_type != 0 && reader->color_type != 3 && reader->bits < 8)) return false;
+            have_header = true;
+            if (fseek(reader->fp, 4, SEEK_CUR) != 0) return false;
+        }
+        else if (memcmp(chunk + 4, "PLTE", 4) == 0) {
+            if (length % 3 != 0 || length > 256 * 3) return false;
+            memset(reader->palette, 0, sizeof(reader->palette));
+            for (uint32_t i = 0; i < length / 3; i++) {
+                if (!read_exact(reader->fp, reader->palette[i], 3)) return false;
+            }
+            reader->palette_size = (int)(length / 3);
+            if (fseek(reader->fp, 4, SEEK_CUR) != 0) return false;
+        }
+        else if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+            if (!have_header || (reader->color_type == 3 && reader->palette_size == 0)) return false;
+            reader->chunk_left = length;
+            break;
+        }
+        else if (memcmp(chunk + 4, "IEND", 4) == 0 || memcmp(chunk + 4, "CgBI", 4) == 0) {
+            return false;
+        }
+        else if (fseek(reader->fp, (long)length + 4, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+
+    const size_t bits_per_pixel = (size_t)reader->channels * reader->bits;
+    reader->raw_stride = ((size_t)reader->width * bits_per_pixel + 7) / 8;
+    reader->filter_bpp = (int)((bits_per_pixel + 7) / 8);
+    reader->previous = (uint8_t*)calloc(reader->raw_stride + 1, 1);
+    reader->inflater = inflater_create(png_read_idat, reader);
+    if (!reader->previous || !reader->inflater) return false;
+
+    reader->kind = SOURCE_PNG;
+    return true;
+}
+
+static int paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return (pb <= pc) ? b : c;
+}
+
+// raw[0] is the filter type, the row follows
+static bool unfilter_png_row(ScanlineReader* reader)
+{
+    uint8_t* row = reader->raw + 1;
+    const uint8_t* up = reader->previous;
+    const size_t stride = reader->raw_stride;
+    const size_t bpp = (size_t)reader->filter_bpp;
+
+    switch (reader->raw[0]) {
+    case 0:
+        break;
+    case 1:
+        for (size_t i = bpp; i < stride; i++) row[i] = (uint8_t)(row[i] + row[i - bpp]);
+        break;
+    case 2:
+        for (size_t i = 0; i < stride; i++) row[i] = (uint8_t)(row[i] + up[i]);
+        break;
+    case 3:
+        for (size_t i = 0; i < stride; i++) {
+            const int left = (i >= bpp) ? row[i - bpp] : 0;
+            row[i] = (uint8_t)(row[i] + ((left + up[i]) >> 1));
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < stride; i++) {
+            const int left = (i >= bpp) ? row[i - bpp] : 0;
+            const int upper_left = (i >= bpp) ? up[i - bpp] : 0;
+            row[i] = (uint8_t)(row[i] + paeth(left, up[i], upper_left));
+        }
+        break;
+    default:
+        return false;
+    }
+    memcpy(reader->previous, row, stride);
+    return true;
+}
+
+static void convert_png_row(const ScanlineReader* reader, uint8_t* rgb)
+{
+    const uint8_t* row = reader->raw + 1;
+    const int bits = reader->bits;
+
+    if (bits < 8) {
+        // Gray samples are scaled to 0-255 like stb_image does; palette samples are indices
+        static const uint8_t scale[9] = { 0, 0xFF, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+        const int mask = (1 << bits) - 1;
+        for (int x = 0; x < reader->width; x++, rgb += RGB_COMPONENTS) {
+            const size_t bit = (size_t)x * bits;
+            const int sample = (row[bit >> 3] >> (8 - bits - (int)(bit & 7))) & mask;
+            if (reader->color_type == 3) {
+                memcpy(rgb, reader->palette[sample], RGB_COMPONENTS);
+            }
+            else {
+                rgb[0] = rgb[1] = rgb[2] = (uint8_t)(sample * scale[bits]);
+            }
+        }
+        return;
+    }
+
+    // 16-bit samples keep their high byte
+    const int sample_size = bits / 8;
+    const int pixel_size = reader->channels * sample_size;
+    for (int x = 0; x < reader->width; x++, rgb += RGB_COMPONENTS, row += pixel_size) {
+        if (reader->color_type == 3) {
+            memcpy(rgb, reader->palette[row[0]], RGB_COMPONENTS);
+        }
+        else if (reader->channels >= 3) {
+            rgb[0] = row[0];
+            rgb[1] = row[sample_size];
+            rgb[2] = row[2 * sample_size];
+        }
+        else {
+            rgb[0] = rgb[1] = rgb[2] = row[0];
+        }
+    }
+}
+
+// ---- Shared ----
+
+ScanlineReader* scanline_reader_open(const char* filename)
+{
+    if (!filename) {
+        fileio_error("Null pointer passed to scanline_reader_open.");
+        return NULL;
+    }
+
+    ScanlineReader* reader = (ScanlineReader*)calloc(1, sizeof(ScanlineReader));
+    if (!reader) {
+        fileio_error("Failed to allocate scanline reader.");
+        return NULL;
+    }
+
+    reader->fp = fopen(filename, "rb");
+    if (!reader->fp) {
+        free(reader);
+        fileio_perror("Failed to open input file");
+        return NULL;
+    }
+
+    uint8_t magic[2] = { 0, 0 };
+    const size_t magic_len = fread(magic, 1, sizeof(magic), reader->fp);
+    const char* extension = strrchr(filename, '.');
+    bool opened = false;
+
+    if (magic_len == 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6' || magic[1] == '7')) {
+        opened = open_pnm(reader, (char)magic[1]);
+    }
+    else if (magic_len == 2 && magic[0] == 'B' && magic[1] == 'M') {
+        opened = seek_to(reader->fp, 0) == 0 && open_bmp(reader);
+    }
+    else if (magic_len == 2 && magic[0] == 0x89 && magic[1] == 'P') {
+        opened = seek_to(reader->fp, 0) == 0 && open_png(reader);
+    }
+    else if (extension && (strcmp(extension, ".tga") == 0 || strcmp(extension, ".TGA") == 0)) {
+        opened = seek_to(reader->fp, 0) == 0 && open_tga(reader);
+    }
+
+    if (opened) {
+        const size_t raw_size = reader->raw_stride + 1; // PNG rows carry a filter byte in front
+        reader->raw = (uint8_t*)malloc(raw_size);
+        if (!reader->raw) {
+            scanline_reader_close(reader);
+            fileio_error("Failed to allocate scanline buffer.");
+            return NULL;
+        }
+        return reader;
+    }
+
+    // Not a layout streamed here; stb_image decodes it whole
+    fclose(reader->fp);
+    reader->fp = NULL;
+    inflater_free(reader->inflater);
+    reader->inflater = NULL;
+    free(reader->previous);
+    reader->previous = NULL;
+
+    int channels;
+    reader->decoded = stbi_load(filename, &reader->width, &reader->height, &channels, RGB_COMPONENTS);
+    if (!reader->decoded) {
+        fprintf(stderr, "Failed to load image: %s\n", filename);
+        free(reader);
+        return NULL;
+    }
+    reader->kind = SOURCE_DECODED;
+    return reader;
+}
+
+void scanline_reader_close(ScanlineReader* reader)
+{
+    if (!reader) return;
+    if (reader->fp) fclose(reader->fp);
+    inflater_free(reader->inflater);
+    free(reader->previous);
+    free(reader->raw);
+    if (reader->decoded) stbi_image_free(reader->decoded);
+    free(reader);
+}
+
+int scanline_reader_width(const ScanlineReader* reader)
+{
+    return reader ? reader->width : 0;
+}
+
+int scanline_reader_height(const ScanlineReader* reader)
+{
+    return reader ? reader->height : 0;
+}
+
+bool scanline_reader_is_streaming(const ScanlineReader* reader)
+{
+    return reader && reader->kind != SOURCE_DECODED;
+}
+
+int scanline_reader_read_row(ScanlineReader* reader, uint8_t* rgb)
+{
+    if (!reader || !rgb) {
+        return fileio_error("Null pointer passed to scanline_reader_read_row.");
+    }
+    if (reader->next_row >= reader->height) {
+        return fileio_error("Read past the last row of the image.");
+    }
+
+    const int y = reader->next_row++;
+    const int width = reader->width;
+
+    if (reader->kind == SOURCE_DECODED) {
+        memcpy(rgb, reader->decoded + (size_t)y * width * RGB_COMPONENTS, (size_t)width * RGB_COMPONENTS);
+        return EXIT_SUCCESS;
+    }
+
+    if (reader->kind == SOURCE_PNG) {
+        if (inflater_read(reader->inflater, reader->raw, reader->raw_stride + 1) != EXIT_SUCCESS || !unfilter_png_row(reader)) {
+            return fileio_error("Corrupt PNG image data.");
+        }
+        convert_png_row(reader, rgb);
+        return EXIT_SUCCESS;
+    }
+
+    if (reader->bottom_up) {
+        const uint64_t stored_row = (uint64_t)(reader->height - 1 - y);
+        if (seek_to(reader->fp, reader->data_offset + stored_row * reader->raw_stride) != 0) {
+            return fileio_perror("Failed to seek in input file");
+        }
+    }
+    const bool ok = (reader->kind == SOURCE_TGA && reader->rle) ? read_tga_rle_row(reader)
+                                                                 : read_exact(reader->fp, reader->raw, reader->raw_stride);
+    if (!ok) {
+        return fileio_error("Input file is truncated.");
+    }
+
+    const uint8_t* raw = reader->raw;
+    switch (reader->kind) {
+    case SOURCE_PNM: {
+        const int sample_size = reader->bits / 8;
+        const int pixel_size = reader->channels * sample_size;
+        for (int x = 0; x < width; x++, raw += pixel_size, rgb += RGB_COMPONENTS) {
+            if (reader->channels >= 3) {
+                rgb[0] = raw[0];
+                rgb[1] = raw[sample_size];
+                rgb[2] = raw[2 * sample_size];
+            }
+            else {
+                rgb[0] = rgb[1] = rgb[2] = raw[0];
+            }
+        }
+        break;
+    }
+    case SOURCE_BMP:
+        if (reader->bits >= 24) {
+            const int pixel_size = reader->bits / 8;
+            for (int x = 0; x < width; x++, raw += pixel_size, rgb += RGB_COMPONENTS) {
+                rgb[0] = raw[2];
+                rgb[1] = raw[1];
+                rgb[2] = raw[0];
+            }
+        }
+        else {
+            const int bits = reader->bits;
+            const int mask = (1 << bits) - 1;
+            for (int x = 0; x < width; x++, rgb += RGB_COMPONENTS) {
+                const size_t bit = (size_t)x * bits;
+                const int index = (raw[bit >> 3] >> (8 - bits - (int)(bit & 7))) & mask;
+                memcpy(rgb, reader->palette[index], RGB_COMPONENTS);
+            }
+        }
+        break;
+    case SOURCE_TGA:
+        for (int x = 0; x < width; x++, raw += reader->channels, rgb += RGB_COMPONENTS) {
+            if (reader->palette_size > 0) {
+                memcpy(rgb, reader->palette[raw[0] < reader->palette_size ? raw[0] : 0], RGB_COMPONENTS);
+            }
+            else if (reader->channels == 1) {
+                rgb[0] = rgb[1] = rgb[2] = raw[0];
+            }
+            else {
+                rgb[0] = raw[2];
+                rgb[1] = raw[1];
+                rgb[2] = raw[0];
+            }
+        }
+        break;
+    default:
+        return fileio_error("Unknown scanline source.");
+    }
+    return EXIT_SUCCESS;
+}
+
+int scanline_reader_read_image(ScanlineReader* reader, ImageData* image)
+{
+    if (!reader || !image) {
+        return fileio_error("Null pointer passed to scanline_reader_read_image.");
+    }
+
+    const size_t row_size = (size_t)reader->width * RGB_COMPONENTS;
+    // malloc, so the buffer can be released with stbi_image_free like any loaded image
+    uint8_t* data = (uint8_t*)malloc(row_size * reader->height + 1);
+    if (!data) {
+        return fileio_error("Failed to allocate image memory.");
+    }
+    for (int y = reader->next_row; y < reader->height; y++) {
+        if (scanline_reader_read_row(reader, data + (size_t)y * row_size) != EXIT_SUCCESS) {
+            free(data);
+            return EXIT_FAILURE;
+        }
+    }
+
+    image->data = data;
+    image->width = reader->width;
+    image->height = reader->height;
+    image->format = PIXEL_FORMAT_RGB888;
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
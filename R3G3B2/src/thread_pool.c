@@ -0,0 +1,352 @@
+/*********************************************************
+ *                                                       *
+ * MJM + AI 2025                                         *
+ * This code is in the public domain.                    *
+ * http://creativecommons.org/publicdomain/zero/1.0/     *
+ *                                                       *
+ *********************************************************/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "thread_pool.h"
+
+#if defined(_WIN32)
+typedef HANDLE             thread_handle;
+typedef CRITICAL_SECTION   pool_mutex;
+typedef CONDITION_VARIABLE pool_cond;
+#define pool_mutex_init(m)    InitializeCriticalSection(m)
+#define pool_mutex_destroy(m) DeleteCriticalSection(m)
+#define pool_mutex_lock(m)    EnterCriticalSection(m)
+#define pool_mutex_unlock(m)  LeaveCriticalSection(m)
+#define pool_cond_init(c)     InitializeConditionVariable(c)
+#define pool_cond_destroy(c)  ((void)(c))
+#define pool_cond_wait(c, m)  SleepConditionVariableCS(c, m, INFINITE)
+#define pool_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_t       thread_handle;
+typedef pthread_mutex_t pool_mutex;
+typedef pthread_cond_t  pool_cond;
+#define pool_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define pool_mutex_destroy(m) pthread_mutex_destroy(m)
+#define pool_mutex_lock(m)    pthread_mutex_lock(m)
+#define pool_mutex_unlock(m)  pthread_mutex_unlock(m)
+#define pool_cond_init(c)     pthread_cond_init(c, NULL)
+#define pool_cond_destroy(c)  pthread_cond_destroy(c)
+#define pool_cond_wait(c, m)  pthread_cond_wait(c, m)
+#define pool_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct {
+    ThreadPool* pool;
+    int index;
+} WorkerStart;
+
+/*
+ * Workers are started once and sleep between jobs. thread_pool_run publishes a task by bumping
+ * the generation counter; the calling thread runs as worker 0 and returns when all are done.
+ */
+struct ThreadPool {
+    int thread_count;
+    thread_handle* threads;
+    WorkerStart* starts;
+    pool_mutex mutex;
+    pool_cond start_cond;
+    pool_cond done_cond;
+    unsigned generation;
+    int remaining;
+    int shutdown;
+    ThreadTask task;
+    void* context;
+};
+
+int cpu_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static void worker_loop(ThreadPool* pool, int index)
+{
+    unsigned seen = 0;
+
+    for (;;) {
+        pool_mutex_lock(&pool->mutex);
+        while (!pool->shutdown && pool->generation == seen) {
+            pool_cond_wait(&pool->start_cond, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            pool_mutex_unlock(&pool->mutex);
+            return;
+        }
+        seen = pool->generation;
+        ThreadTask task = pool->task;
+        void* context = pool->context;
+        pool_mutex_unlock(&pool->mutex);
+
+        task(context, index);
+
+        pool_mutex_lock(&pool->mutex);
+        if (--pool->remaining == 0) {
+            pool_cond_broadcast(&pool->done_cond);
+        }
+        pool_mutex_unlock(&pool->mutex);
+    }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI worker_entry(LPVOID arg)
+{
+    WorkerStart* start = (WorkerStart*)arg;
+    worker_loop(start->pool, start->index);
+    return 0;
+}
+#else
+static void* worker_entry(void* arg)
+{
+    WorkerStart* start = (WorkerStart*)arg;
+    worker_loop(start->pool, start->index);
+    return NULL;
+}
+#endif
+
+ThreadPool* thread_pool_create(int thread_count)
+{
+    if (thread_count <= 0) {
+        thread_count = cpu_count();
+    }
+
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    pool->thread_count = thread_count;
+    pool_mutex_init(&pool->mutex);
+    pool_cond_init(&pool->start_cond);
+    pool_cond_init(&pool->done_cond);
+
+    if (thread_count > 1) {
+        pool->threads = (thread_handle*)calloc(thread_count - 1, sizeof(thread_handle));
+        pool->starts = (WorkerStart*)calloc(thread_count - 1, sizeof(WorkerStart));
+        if (!pool->threads || !pool->starts) {
+            pool->thread_count = 1;
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 1; i < thread_count; i++) {
+        pool->starts[i - 1].pool = pool;
+        pool->starts[i - 1].index = i;
+#if defined(_WIN32)
+        pool->threads[i - 1] = CreateThread(NULL, 0, worker_entry, &pool->starts[i - 1], 0, NULL);
+        int started = pool->threads[i - 1] != NULL;
+#else
+        int started = pthread_create(&pool->threads[i - 1], NULL, worker_entry, &pool->starts[i - 1]) == 0;
+#endif
+        if (!started) {
+            // Run with the workers that did start
+            pool->thread_count = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool* pool)
+{
+    if (!pool) return;
+
+    pool_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pool_cond_broadcast(&pool->start_cond);
+    pool_mutex_unlock(&pool->mutex);
+
+    for (int i = 1; i < pool->thread_count; i++) {
+#if defined(_WIN32)
+        WaitForSingleObject(pool->threads[i - 1], INFINITE);
+        CloseHandle(pool->threads[i - 1]);
+#else
+        pthread_join(pool->threads[i - 1], NULL);
+#endif
+    }
+
+    pool_cond_destroy(&pool->done_cond);
+    pool_cond_destroy(&pool->start_cond);
+    pool_mutex_destroy(&pool->mutex);
+    free(pool->starts);
+    free(pool->threads);
+    free(pool);
+}
+
+int thread_pool_size(const ThreadPool* pool)
+{
+    return pool ? pool->thread_count : 1;
+}
+
+void thread_pool_run(ThreadPool* pool, ThreadTask task, void* context)
+{
+    if (!pool || pool->thread_count == 1) {
+        task(context, 0);
+        return;
+    }
+
+    pool_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->remaining = pool->thread_count - 1;
+    pool->generation++;
+    pool_cond_broadcast(&pool->start_cond);
+    pool_mutex_unlock(&pool->mutex);
+
+    task(context, 0);
+
+    pool_mutex_lock(&pool->mutex);
+    while (pool->remaining > 0) {
+        pool_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool_mutex_unlock(&pool->mutex);
+}
+
+struct WorkQueue {
+    void** items;
+    int capacity;
+    int head;   // Oldest item
+    int count;
+    int closed;
+    pool_mutex mutex;
+    pool_cond changed; // Signalled on every push, pop and close
+};
+
+WorkQueue* work_queue_create(int capacity)
+{
+    if (capacity <= 0) return NULL;
+
+    WorkQueue* queue = (WorkQueue*)calloc(1, sizeof(WorkQueue));
+    if (!queue) return NULL;
+    queue->items = (void**)calloc(capacity, sizeof(void*));
+    if (!queue->items) {
+        free(queue);
+        return NULL;
+    }
+    queue->capacity = capacity;
+    pool_mutex_init(&queue->mutex);
+    pool_cond_init(&queue->changed);
+    return queue;
+}
+
+void work_queue_destroy(WorkQueue* queue)
+{
+    if (!queue) return;
+    pool_cond_destroy(&queue->changed);
+    pool_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+}
+
+int work_queue_push(WorkQueue* queue, void* item)
+{
+    pool_mutex_lock(&queue->mutex);
+    while (!queue->closed && queue->count == queue->capacity) {
+        pool_cond_wait(&queue->changed, &queue->mutex);
+    }
+    const int closed = queue->closed;
+    if (!closed) {
+        queue->items[(queue->head + queue->count) % queue->capacity] = item;
+        queue->count++;
+        pool_cond_broadcast(&queue->changed);
+    }
+    pool_mutex_unlock(&queue->mutex);
+    return closed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void* work_queue_pop(WorkQueue* queue)
+{
+    void* item = NULL;
+    pool_mutex_lock(&queue->mutex);
+    while (!queue->closed && queue->count == 0) {
+        pool_cond_wait(&queue->changed, &queue->mutex);
+    }
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pool_cond_broadcast(&queue->changed);
+    }
+    pool_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+void work_queue_close(WorkQueue* queue)
+{
+    pool_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pool_cond_broadcast(&queue->changed);
+    pool_mutex_unlock(&queue->mutex);
+}
+
+int pool_load_acquire(const volatile int* value)
+{
+#if defined(_MSC_VER)
+    return (int)InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void pool_store_release(volatile int* value, int new_value)
+{
+#if defined(_MSC_VER)
+    InterlockedExchange((volatile LONG*)value, (LONG)new_value);
+#else
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+#endif
+}
+
+int pool_atomic_fetch_add(volatile int* value, int addend)
+{
+#if defined(_MSC_VER)
+    return (int)InterlockedExchangeAdd((volatile LONG*)value, (LONG)addend);
+#else
+    return __atomic_fetch_add(value, addend, __ATOMIC_ACQ_REL);
+#endif
+}
+
+void pool_yield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+double wall_clock_seconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
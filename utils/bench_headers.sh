@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# MJM + AI 2025
+# This code is in the public domain.
+# http://creativecommons.org/publicdomain/zero/1.0/
+#
+# Measures what each -h encoding costs the code that includes it: the header size, the time
+# `cc -c` takes on a file including it, and the compiler's peak memory (needs GNU time).
+#
+# usage: bench_headers.sh <R3G3B2 binary> [image] [compiler]
+# Without an image a 1024x600 noise picture is used, the worst case for the string encoding.
+
+CONVERTER=${1:?usage: bench_headers.sh <R3G3B2 binary> [image] [compiler]}
+IMAGE=$2
+CC=${3:-${CC:-cc}}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if [ -z "$IMAGE" ]; then
+    IMAGE=$WORK/noise.ppm
+    { printf 'P6\n1024 600\n255\n'; head -c 1843200 /dev/urandom; } > "$IMAGE"
+fi
+
+seconds() {
+    date +%s.%N
+}
+
+printf '%-8s %12s %10s %12s\n' encoding "header bytes" "cc -c (s)" "peak (KiB)"
+for encoding in bytes string words embed; do
+    header=$WORK/bench_$encoding.h
+    if ! "$CONVERTER" -i "$IMAGE" -h -o "$header" -encoding "$encoding" > /dev/null; then
+        echo "$encoding: conversion failed"
+        continue
+    fi
+    # The header includes image_types.h, which it carries in a comment
+    sed -n '/^#ifndef IMAGE_TYPES_H/,/^#endif \/\/ IMAGE_TYPES_H/p' "$header" > "$WORK/image_types.h"
+    printf '#include "bench_%s.h"\nconst Image_t* bench_image(void) { return &bench_%s_image; }\n' "$encoding" "$encoding" > "$WORK/use_$encoding.c"
+
+    if [ "$encoding" = embed ] && ! printf 'static const char e[] = {\n#embed __FILE__\n};\n' | "$CC" -std=c2x -x c -c -o /dev/null - 2> /dev/null; then
+        printf '%-8s %12s %10s %12s\n' "$encoding" "$(wc -c < "$header")" "no #embed" -
+        continue
+    fi
+
+    peak=-
+    start=$(seconds)
+    if [ -x /usr/bin/time ]; then
+        peak=$( { /usr/bin/time -f '%M' "$CC" -std=c2x -c -o "$WORK/use.o" "$WORK/use_$encoding.c" 2>&1 >/dev/null; } | tail -n 1)
+    else
+        "$CC" -std=c2x -c -o "$WORK/use.o" "$WORK/use_$encoding.c"
+    fi
+    end=$(seconds)
+    printf '%-8s %12s %10s %12s\n' "$encoding" "$(wc -c < "$header")" "$(awk "BEGIN { printf \"%.3f\", $end - $start }")" "$peak"
+done